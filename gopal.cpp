@@ -17,7 +17,6 @@
 
 static gboolean gopal_initialized = FALSE;
 static PLibraryProcess *process = NULL;
-static MmBackend *mmbackend = NULL;
 
 static gboolean
 parse_goption_arg (const char *opt,
@@ -63,8 +62,7 @@ init_pre (GOptionContext *ctxt,
 static gboolean
 load_plugins ()
 {
-    mmbackend = mm_backend_new ();
-    if (!load_sound_channel (mmbackend))
+    if (!load_sound_channel ())
 	return FALSE;
 
     return TRUE;
@@ -208,8 +206,7 @@ gopal_init_check (int *argc, char **argv[], GError **error)
 void
 gopal_deinit ()
 {
-    if (mmbackend)
-	g_object_unref (mmbackend);
+    mm_backend_clear_cache ();
 
     if (process)
 	delete process;
@@ -12,6 +12,7 @@
 #include "gopalsipep.h"
 #include "gopalpcssep.h"
 #include "gopalenum.h"
+#include "soundgst.h"
 
 #include <ptlib.h>
 #include <opal/manager.h>
@@ -23,6 +24,8 @@ class MyManager : public OpalManager
 public:
     MyManager(GopalManager *mgr) : m_manager(mgr) { };
     void SendUserInputTone(PString callToken, char tone);
+    PBoolean HoldCall(PString callToken, bool hold);
+    PBoolean IsCallOnHold(PString callToken);
 
 private:
     virtual void OnEstablishedCall(OpalCall & call);
@@ -49,6 +52,38 @@ MyManager::SendUserInputTone(PString callToken, char tone)
     }
 }
 
+PBoolean
+MyManager::HoldCall(PString callToken, bool hold)
+{
+    if (callToken.IsEmpty())
+        return false;
+
+    PSafePtr<OpalCall> call = FindCallWithLock(callToken);
+    if (call == NULL)
+        return false;
+
+    if (hold ? !call->Hold() : !call->Retrieve())
+        return false;
+
+    // the media is parked, or resumed, without waiting for the remote
+    // party to agree
+    sound_channel_set_hold(callToken, hold);
+    return true;
+}
+
+PBoolean
+MyManager::IsCallOnHold(PString callToken)
+{
+    if (callToken.IsEmpty())
+        return false;
+
+    PSafePtr<OpalCall> call = FindCallWithLock(callToken, PSafeReadOnly);
+    if (call == NULL)
+        return false;
+
+    return call->IsOnHold();
+}
+
 void
 MyManager::OnEstablishedCall(OpalCall & call)
 {
@@ -60,6 +95,7 @@ void MyManager::OnClearedCall(OpalCall & call)
 {
     OpalManager::OnClearedCall(call);
     const gchar *token = call.GetToken();
+    sound_channel_set_hold(token, FALSE);
     const gchar *name = call.GetPartyB().IsEmpty() ? call.GetPartyA() : call.GetPartyB();
     OpalConnection::CallEndReason endreason = call.GetCallEndReason();
     GopalCallEndReason reason = GopalCallEndReason(endreason.code);
@@ -514,6 +550,61 @@ gopal_manager_clear_call (GopalManager *self,
     return MANAGER (self)->ClearCall (tok, OpalConnection::CallEndReason(reason));
 }
 
+/**
+ * gopal_manager_hold_call:
+ * @self: #GopalManager instance
+ * @token: the token of the call
+ *
+ * Put a call on hold.
+ *
+ * The remote party is asked to hold the call, and the local media of
+ * the call is parked right away: its pipelines pause and its sound
+ * channels stop pacing frames until the call is retrieved.
+ *
+ * Returns: %TRUE if the call was found and the hold requested
+ */
+gboolean
+gopal_manager_hold_call (GopalManager *self, const char *token)
+{
+    g_return_val_if_fail (token != NULL, FALSE);
+    return MANAGER (self)->HoldCall (PString (token), true);
+}
+
+/**
+ * gopal_manager_retrieve_call:
+ * @self: #GopalManager instance
+ * @token: the token of the call
+ *
+ * Retrieve a call from hold.
+ *
+ * The local media resumes at once, within a frame time.
+ *
+ * Returns: %TRUE if the call was found and the retrieve requested
+ */
+gboolean
+gopal_manager_retrieve_call (GopalManager *self, const char *token)
+{
+    g_return_val_if_fail (token != NULL, FALSE);
+    return MANAGER (self)->HoldCall (PString (token), false);
+}
+
+/**
+ * gopal_manager_is_call_on_hold:
+ * @self: #GopalManager instance
+ * @token: the token of the call
+ *
+ * Determine if a call is on hold.
+ *
+ * Returns: %TRUE if there is a call with the specified token and it
+ * is on hold
+ */
+gboolean
+gopal_manager_is_call_on_hold (GopalManager *self, const char *token)
+{
+    g_return_val_if_fail (token != NULL, FALSE);
+    return MANAGER (self)->IsCallOnHold (PString (token));
+}
+
 const struct {
     GopalCallEndReason reason;
     const char *msg;
@@ -178,6 +178,18 @@ gopal_manager_clear_call                       (GopalManager *self,
 						const char *token,
 						GopalCallEndReason reason);
 
+gboolean
+gopal_manager_hold_call                        (GopalManager *self,
+						const char *token);
+
+gboolean
+gopal_manager_retrieve_call                    (GopalManager *self,
+						const char *token);
+
+gboolean
+gopal_manager_is_call_on_hold                  (GopalManager *self,
+						const char *token);
+
 const char *
 gopal_manager_get_end_reason_string            (GopalCallEndReason reason);
 
@@ -13,6 +13,9 @@
 #include <ptlib.h>
 #include <opal/pcss.h>
 
+#include "soundgst.h"
+#include "mmbackend.h"
+
 class MyPCSSEndPoint : public OpalPCSSEndPoint
 {
     PCLASSINFO(MyPCSSEndPoint, OpalPCSSEndPoint);
@@ -24,14 +27,36 @@ public:
 
     virtual PBoolean OnShowIncoming(const OpalPCSSConnection & connection);
     virtual PBoolean OnShowOutgoing(const OpalPCSSConnection & connection);
+    virtual PSoundChannel * CreateSoundChannel(const OpalPCSSConnection & connection,
+                                               const OpalMediaFormat & mediaFormat,
+                                               PBoolean isSource);
 
 private:
     GopalPCSSEP *m_pcssep;
 };
 
+// the GStreamer channel on the sound hardware; the synthetic
+// "Gst:test" and "Gst:wav=" devices neither prewarm nor share pipelines
+static inline bool
+is_gst_device(const PString & name)
+{
+    return name == "Gst" || name.NumCompare("Gst:dev=", 8) == PObject::EqualTo;
+}
+
+// only the default device has its pipelines kept between calls
+static inline bool
+is_gst_default_device(const PString & name)
+{
+    return name == "Gst";
+}
+
 PBoolean
 MyPCSSEndPoint::OnShowIncoming(const OpalPCSSConnection & connection)
 {
+    // get the audio ready while the phone rings
+    if (is_gst_default_device(connection.GetSoundChannelPlayDevice()))
+        sound_channel_prewarm();
+
     const gchar *token = connection.GetCall().GetToken();
     const gchar *name = connection.GetRemotePartyName();
     const gchar *address = connection.GetRemotePartyAddress();
@@ -43,11 +68,49 @@ MyPCSSEndPoint::OnShowIncoming(const OpalPCSSConnection & connection)
 PBoolean
 MyPCSSEndPoint::OnShowOutgoing(const OpalPCSSConnection & connection)
 {
+    if (is_gst_default_device(connection.GetSoundChannelPlayDevice()))
+        sound_channel_prewarm();
+
     const gchar *remote_name = connection.GetRemotePartyName();
     g_signal_emit_by_name(m_pcssep, "call-outgoing", remote_name);
     return true;
 }
 
+PSoundChannel *
+MyPCSSEndPoint::CreateSoundChannel(const OpalPCSSConnection & connection,
+                                   const OpalMediaFormat & mediaFormat,
+                                   PBoolean isSource)
+{
+    PSoundChannel::Directions dir;
+    PString deviceName;
+
+    if (isSource) {
+        deviceName = connection.GetSoundChannelRecordDevice();
+        dir = PSoundChannel::Recorder;
+    } else {
+        deviceName = connection.GetSoundChannelPlayDevice();
+        dir = PSoundChannel::Player;
+    }
+
+    // only the GStreamer channels of a call can share a pipeline, join
+    // the conference or be held
+    if (!is_gst_device(deviceName))
+        return OpalPCSSEndPoint::CreateSoundChannel(connection,
+                                                    mediaFormat,
+                                                    isSource);
+
+    PSoundChannel *channel =
+        sound_channel_new_for_call(connection.GetCall().GetToken());
+
+    unsigned channels =
+        mediaFormat.GetOptionInteger(OpalAudioFormat::ChannelsOption(), 1);
+    if (channel->Open(deviceName, dir, channels, mediaFormat.GetClockRate(), 16))
+        return channel;
+
+    PTRACE(1, "PCSS\tCould not open sound channel \"" << deviceName << '"');
+    delete channel;
+    return NULL;
+}
 
 G_BEGIN_DECLS
 
@@ -56,6 +119,7 @@ enum { PROP_MANAGER = 1, PROP_PCSS, PROP_LAST };
 struct _GopalPCSSEPPrivate
 {
     MyPCSSEndPoint *pcssep;
+    OpalSilenceDetector::Params silence; /* restored without VAD */
 };
 
 #define GET_PRIVATE(obj)			\
@@ -281,6 +345,83 @@ gopal_pcss_ep_get_soundchannel_record_device (GopalPCSSEP *self)
     return PCSSEP(self)->GetSoundChannelRecordDevice();
 }
 
+/**
+ * gopal_pcss_ep_list_soundchannel_play_devices:
+ * @self: #GopalPCSSEP instance
+ *
+ * Returns: (transfer full) (array zero-terminated=1): the names of the
+ * devices gopal_pcss_ep_set_soundchannel_play_device() takes for the
+ * GStreamer sound channel
+ *
+ * The sound devices come from a monitor that follows them as they are
+ * plugged and unplugged, so listing them does not probe the hardware.
+ * A "Gst:dev=" device that is gone when a call starts is replaced by
+ * the default one.
+ */
+gchar **
+gopal_pcss_ep_list_soundchannel_play_devices (GopalPCSSEP *self)
+{
+    return sound_channel_list_devices (MM_BACKEND_DIRECTION_PLAYER);
+}
+
+/**
+ * gopal_pcss_ep_list_soundchannel_record_devices:
+ * @self: #GopalPCSSEP instance
+ *
+ * Returns: (transfer full) (array zero-terminated=1): the names of the
+ * devices gopal_pcss_ep_set_soundchannel_record_device() takes for the
+ * GStreamer sound channel
+ *
+ * See gopal_pcss_ep_list_soundchannel_play_devices().
+ */
+gchar **
+gopal_pcss_ep_list_soundchannel_record_devices (GopalPCSSEP *self)
+{
+    return sound_channel_list_devices (MM_BACKEND_DIRECTION_RECORDER);
+}
+
+/**
+ * gopal_pcss_ep_switch_soundchannel_play_device:
+ * @self: #GopalPCSSEP instance
+ * @token: the token of the call
+ * @name: the name of the device
+ *
+ * Moves the audio played in the call to another device of the
+ * GStreamer sound channel, as listed by
+ * gopal_pcss_ep_list_soundchannel_play_devices(), without stopping the
+ * media: only the sound device is replaced. The default device of the
+ * endpoint does not change.
+ *
+ * Returns: %TRUE if the call now plays on @name
+ */
+gboolean
+gopal_pcss_ep_switch_soundchannel_play_device (GopalPCSSEP *self,
+					       const gchar *token,
+					       const gchar *name)
+{
+    return sound_channel_switch_device (token, MM_BACKEND_DIRECTION_PLAYER,
+					name);
+}
+
+/**
+ * gopal_pcss_ep_switch_soundchannel_record_device:
+ * @self: #GopalPCSSEP instance
+ * @token: the token of the call
+ * @name: the name of the device
+ *
+ * See gopal_pcss_ep_switch_soundchannel_play_device().
+ *
+ * Returns: %TRUE if the call now records from @name
+ */
+gboolean
+gopal_pcss_ep_switch_soundchannel_record_device (GopalPCSSEP *self,
+						 const gchar *token,
+						 const gchar *name)
+{
+    return sound_channel_switch_device (token, MM_BACKEND_DIRECTION_RECORDER,
+					name);
+}
+
 /**
  * gopal_pcss_ep_set_soundchannel_buffer_time:
  * @self: #GopalPCSSEP instance
@@ -351,4 +492,560 @@ gopal_pcss_ep_reject_incoming_connection (GopalPCSSEP *self,
         );
 }
 
+/**
+ * gopal_pcss_ep_set_duplex_audio:
+ * @self: #GopalPCSSEP instance
+ * @duplex: %TRUE to enable the duplex mode
+ *
+ * In duplex mode the playback and the capture of a call run in a
+ * single GStreamer pipeline, sharing one clock, with an in-process
+ * echo canceller between them when it is available.
+ *
+ * It only affects the calls whose media starts afterwards.
+ */
+void
+gopal_pcss_ep_set_duplex_audio (GopalPCSSEP *self, gboolean duplex)
+{
+    sound_channel_set_duplex (duplex);
+}
+
+/**
+ * gopal_pcss_ep_get_duplex_audio:
+ * @self: #GopalPCSSEP instance
+ *
+ * Returns: %TRUE if the calls use the duplex mode
+ */
+gboolean
+gopal_pcss_ep_get_duplex_audio (GopalPCSSEP *self)
+{
+    return sound_channel_get_duplex ();
+}
+
+/**
+ * gopal_pcss_ep_set_conference_audio:
+ * @self: #GopalPCSSEP instance
+ * @conference: %TRUE to mix the calls into a conference
+ *
+ * In conference mode the audio of every call is mixed into the
+ * speakers, and each call hears the microphone plus the other calls,
+ * but not itself. The calls share one duplex pipeline, brought up by
+ * the first one; the others must use the same sample rate.
+ *
+ * It only affects the calls whose media starts afterwards.
+ */
+void
+gopal_pcss_ep_set_conference_audio (GopalPCSSEP *self, gboolean conference)
+{
+    sound_channel_set_conference (conference);
+}
+
+/**
+ * gopal_pcss_ep_get_conference_audio:
+ * @self: #GopalPCSSEP instance
+ *
+ * Returns: %TRUE if the calls are mixed into a conference
+ */
+gboolean
+gopal_pcss_ep_get_conference_audio (GopalPCSSEP *self)
+{
+    return sound_channel_get_conference ();
+}
+
+/**
+ * gopal_pcss_ep_set_soundchannel_play_element:
+ * @self: #GopalPCSSEP instance
+ * @description: (allow-none): the GStreamer audio sink, such as
+ * "pulsesink", or a pipeline fragment ending in one; %NULL for the
+ * automatic sink
+ *
+ * Picks what the "Gst" sound channel plays the calls with.
+ *
+ * Returns: %FALSE if @description is not valid
+ */
+gboolean
+gopal_pcss_ep_set_soundchannel_play_element (GopalPCSSEP *self,
+                                             const gchar *description)
+{
+    return mm_backend_set_audio_element (MM_BACKEND_DIRECTION_PLAYER,
+                                         description);
+}
+
+/**
+ * gopal_pcss_ep_set_soundchannel_record_element:
+ * @self: #GopalPCSSEP instance
+ * @description: (allow-none): the GStreamer audio source, such as
+ * "alsasrc", or a pipeline fragment starting with one; %NULL for the
+ * automatic source
+ *
+ * Picks what the "Gst" sound channel captures the calls with.
+ *
+ * Returns: %FALSE if @description is not valid
+ */
+gboolean
+gopal_pcss_ep_set_soundchannel_record_element (GopalPCSSEP *self,
+                                               const gchar *description)
+{
+    return mm_backend_set_audio_element (MM_BACKEND_DIRECTION_RECORDER,
+                                         description);
+}
+
+/**
+ * gopal_pcss_ep_set_soundchannel_play_timing:
+ * @self: #GopalPCSSEP instance
+ * @latency_time: microseconds per device period, 0 for the default
+ * @buffer_time: microseconds of device buffering, 0 for the default
+ *
+ * Tunes the buffering of the audio sink of the "Gst" sound channel.
+ */
+void
+gopal_pcss_ep_set_soundchannel_play_timing (GopalPCSSEP *self,
+                                            gint64 latency_time,
+                                            gint64 buffer_time)
+{
+    mm_backend_set_audio_timing (MM_BACKEND_DIRECTION_PLAYER,
+                                 latency_time, buffer_time);
+}
+
+/**
+ * gopal_pcss_ep_set_soundchannel_record_timing:
+ * @self: #GopalPCSSEP instance
+ * @latency_time: microseconds per device period, 0 for the default
+ * @buffer_time: microseconds of device buffering, 0 for the default
+ *
+ * Tunes the buffering of the audio source of the "Gst" sound channel.
+ */
+void
+gopal_pcss_ep_set_soundchannel_record_timing (GopalPCSSEP *self,
+                                              gint64 latency_time,
+                                              gint64 buffer_time)
+{
+    mm_backend_set_audio_timing (MM_BACKEND_DIRECTION_RECORDER,
+                                 latency_time, buffer_time);
+}
+
+/**
+ * gopal_pcss_ep_get_soundchannel_play_latency:
+ * @self: #GopalPCSSEP instance
+ *
+ * Returns: the latency, in microseconds, the audio sink reported
+ * after its last negotiation, or -1 if unknown
+ */
+gint64
+gopal_pcss_ep_get_soundchannel_play_latency (GopalPCSSEP *self)
+{
+    return mm_backend_get_device_latency (MM_BACKEND_DIRECTION_PLAYER);
+}
+
+/**
+ * gopal_pcss_ep_get_soundchannel_record_latency:
+ * @self: #GopalPCSSEP instance
+ *
+ * Returns: the latency, in microseconds, the audio source reported
+ * after its last negotiation, or -1 if unknown
+ */
+gint64
+gopal_pcss_ep_get_soundchannel_record_latency (GopalPCSSEP *self)
+{
+    return mm_backend_get_device_latency (MM_BACKEND_DIRECTION_RECORDER);
+}
+
+/**
+ * gopal_pcss_ep_get_audio_stats:
+ * @self: #GopalPCSSEP instance
+ *
+ * Takes a snapshot of the counters of the "Gst" sound channels of the
+ * process, the ones already closed included. The counters add up all
+ * the channels; the latencies, in microseconds, are the highest.
+ *
+ * The keys are "frames-written", "frames-read", "write-dropped",
+ * "write-underruns", "write-early", "read-dropped", "read-silent",
+ * "read-late", "read-early", "read-blocked-time",
+ * "player-queue-level", "player-start-latency",
+ * "recorder-start-latency", "player-ready-latency",
+ * "recorder-ready-latency", "player-device-latency",
+ * "recorder-device-latency", "device-switch-gap", "deadline-misses",
+ * "render-latency-max",
+ * "render-latency", an array whose element i counts the frames
+ * rendered less than 2^i milliseconds after being written, the last
+ * one all the others, and "read-drop-times", an array of the
+ * g_get_monotonic_time() of the latest captured audio losses, the
+ * latest first, 0 for the unused ones.
+ *
+ * Returns: (transfer floating): a #GVariant of type a{sv}
+ */
+GVariant *
+gopal_pcss_ep_get_audio_stats (GopalPCSSEP *self)
+{
+    MmBackendStats stats;
+    GVariantBuilder builder;
+    GVariant *histogram, *drops;
+
+    mm_backend_get_global_stats (&stats);
+
+    histogram = g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64,
+                                           stats.render_latency,
+                                           MM_BACKEND_LATENCY_BUCKETS,
+                                           sizeof (guint64));
+    drops = g_variant_new_fixed_array (G_VARIANT_TYPE_INT64,
+                                       stats.read_drop_times,
+                                       MM_BACKEND_DROP_HISTORY,
+                                       sizeof (gint64));
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&builder, "{sv}", "frames-written",
+                           g_variant_new_uint64 (stats.frames_written));
+    g_variant_builder_add (&builder, "{sv}", "frames-read",
+                           g_variant_new_uint64 (stats.frames_read));
+    g_variant_builder_add (&builder, "{sv}", "write-dropped",
+                           g_variant_new_uint64 (stats.write_dropped));
+    g_variant_builder_add (&builder, "{sv}", "write-underruns",
+                           g_variant_new_uint64 (stats.write_underruns));
+    g_variant_builder_add (&builder, "{sv}", "write-early",
+                           g_variant_new_uint64 (stats.write_early));
+    g_variant_builder_add (&builder, "{sv}", "read-dropped",
+                           g_variant_new_uint64 (stats.read_dropped));
+    g_variant_builder_add (&builder, "{sv}", "read-silent",
+                           g_variant_new_uint64 (stats.read_silent));
+    g_variant_builder_add (&builder, "{sv}", "read-late",
+                           g_variant_new_uint64 (stats.read_late));
+    g_variant_builder_add (&builder, "{sv}", "read-early",
+                           g_variant_new_uint64 (stats.read_early));
+    g_variant_builder_add (&builder, "{sv}", "read-blocked-time",
+                           g_variant_new_int64 (stats.read_blocked_time));
+    g_variant_builder_add (&builder, "{sv}", "player-queue-level",
+                           g_variant_new_int64 (stats.player_queue_level));
+    g_variant_builder_add (&builder, "{sv}", "player-start-latency",
+                           g_variant_new_int64 (stats.player_start_latency));
+    g_variant_builder_add (&builder, "{sv}", "recorder-start-latency",
+                           g_variant_new_int64 (stats.recorder_start_latency));
+    g_variant_builder_add (&builder, "{sv}", "player-ready-latency",
+                           g_variant_new_int64 (stats.player_ready_latency));
+    g_variant_builder_add (&builder, "{sv}", "recorder-ready-latency",
+                           g_variant_new_int64 (stats.recorder_ready_latency));
+    g_variant_builder_add (&builder, "{sv}", "player-device-latency",
+                           g_variant_new_int64 (stats.player_device_latency));
+    g_variant_builder_add (&builder, "{sv}", "recorder-device-latency",
+                           g_variant_new_int64 (stats.recorder_device_latency));
+    g_variant_builder_add (&builder, "{sv}", "device-switch-gap",
+                           g_variant_new_int64 (stats.device_switch_gap));
+    g_variant_builder_add (&builder, "{sv}", "deadline-misses",
+                           g_variant_new_uint64 (stats.deadline_misses));
+    g_variant_builder_add (&builder, "{sv}", "render-latency-max",
+                           g_variant_new_int64 (stats.render_latency_max));
+    g_variant_builder_add (&builder, "{sv}", "render-latency", histogram);
+    g_variant_builder_add (&builder, "{sv}", "read-drop-times", drops);
+
+    return g_variant_builder_end (&builder);
+}
+
+/**
+ * gopal_pcss_ep_set_soundchannel_play_mute:
+ * @self: #GopalPCSSEP instance
+ * @mute: %TRUE to mute the speakers
+ *
+ * Silences the calls played by the "Gst" sound channel, from the next
+ * frame on, without stopping their audio pipelines.
+ */
+void
+gopal_pcss_ep_set_soundchannel_play_mute (GopalPCSSEP *self, gboolean mute)
+{
+    mm_backend_set_mute (MM_BACKEND_DIRECTION_PLAYER, mute);
+}
+
+/**
+ * gopal_pcss_ep_get_soundchannel_play_mute:
+ * @self: #GopalPCSSEP instance
+ *
+ * Returns: %TRUE if the speakers are muted
+ */
+gboolean
+gopal_pcss_ep_get_soundchannel_play_mute (GopalPCSSEP *self)
+{
+    return mm_backend_get_mute (MM_BACKEND_DIRECTION_PLAYER);
+}
+
+/**
+ * gopal_pcss_ep_set_soundchannel_record_mute:
+ * @self: #GopalPCSSEP instance
+ * @mute: %TRUE to mute the microphone
+ *
+ * Sends silence, from the next frame on, instead of the audio
+ * captured by the "Gst" sound channel.
+ */
+void
+gopal_pcss_ep_set_soundchannel_record_mute (GopalPCSSEP *self, gboolean mute)
+{
+    mm_backend_set_mute (MM_BACKEND_DIRECTION_RECORDER, mute);
+}
+
+/**
+ * gopal_pcss_ep_get_soundchannel_record_mute:
+ * @self: #GopalPCSSEP instance
+ *
+ * Returns: %TRUE if the microphone is muted
+ */
+gboolean
+gopal_pcss_ep_get_soundchannel_record_mute (GopalPCSSEP *self)
+{
+    return mm_backend_get_mute (MM_BACKEND_DIRECTION_RECORDER);
+}
+
+/**
+ * gopal_pcss_ep_set_soundchannel_play_gain:
+ * @self: #GopalPCSSEP instance
+ * @gain: the linear gain, from 0 to 8; 1 leaves the audio untouched
+ *
+ * Amplifies the calls played by the "Gst" sound channel.
+ */
+void
+gopal_pcss_ep_set_soundchannel_play_gain (GopalPCSSEP *self, gdouble gain)
+{
+    mm_backend_set_gain (MM_BACKEND_DIRECTION_PLAYER, gain);
+}
+
+/**
+ * gopal_pcss_ep_get_soundchannel_play_gain:
+ * @self: #GopalPCSSEP instance
+ *
+ * Returns: the linear gain of the speakers
+ */
+gdouble
+gopal_pcss_ep_get_soundchannel_play_gain (GopalPCSSEP *self)
+{
+    return mm_backend_get_gain (MM_BACKEND_DIRECTION_PLAYER);
+}
+
+/**
+ * gopal_pcss_ep_set_soundchannel_record_gain:
+ * @self: #GopalPCSSEP instance
+ * @gain: the linear gain, from 0 to 8; 1 leaves the audio untouched
+ *
+ * Amplifies the audio captured by the "Gst" sound channel.
+ */
+void
+gopal_pcss_ep_set_soundchannel_record_gain (GopalPCSSEP *self, gdouble gain)
+{
+    mm_backend_set_gain (MM_BACKEND_DIRECTION_RECORDER, gain);
+}
+
+/**
+ * gopal_pcss_ep_get_soundchannel_record_gain:
+ * @self: #GopalPCSSEP instance
+ *
+ * Returns: the linear gain of the microphone
+ */
+gdouble
+gopal_pcss_ep_get_soundchannel_record_gain (GopalPCSSEP *self)
+{
+    return mm_backend_get_gain (MM_BACKEND_DIRECTION_RECORDER);
+}
+
+/**
+ * gopal_pcss_ep_set_voice_activity_detection:
+ * @self: #GopalPCSSEP instance
+ * @enable: %TRUE to suppress the frames without speech
+ *
+ * The "Gst" sound channel detects when nobody speaks and hands
+ * silence to Opal, whose silence detection is then set to suppress
+ * those frames, so they are neither encoded nor sent. Disabling it
+ * restores the previous silence detection of Opal. Opal applies its
+ * settings to the calls started afterwards.
+ *
+ * The fraction of frames suppressed is "read-silent" over
+ * "frames-read" in gopal_pcss_ep_get_audio_stats().
+ */
+void
+gopal_pcss_ep_set_voice_activity_detection (GopalPCSSEP *self,
+                                            gboolean enable)
+{
+    OpalManager & manager = PCSSEP (self)->GetManager ();
+
+    if (enable == mm_backend_get_voice_activity ())
+        return;
+
+    if (enable) {
+        self->priv->silence = manager.GetSilenceDetectParams ();
+
+        // only our zeroed frames are under the threshold
+        OpalSilenceDetector::Params params (
+            OpalSilenceDetector::FixedSilenceDetection, 1);
+        params.m_signalDeadband = 0;
+        params.m_silenceDeadband = 0;
+        manager.SetSilenceDetectParams (params);
+    } else {
+        manager.SetSilenceDetectParams (self->priv->silence);
+    }
+
+    mm_backend_set_voice_activity (enable);
+}
+
+/**
+ * gopal_pcss_ep_get_voice_activity_detection:
+ * @self: #GopalPCSSEP instance
+ *
+ * Returns: %TRUE if the frames without speech are suppressed
+ */
+gboolean
+gopal_pcss_ep_get_voice_activity_detection (GopalPCSSEP *self)
+{
+    return mm_backend_get_voice_activity ();
+}
+
+/**
+ * gopal_pcss_ep_set_voice_activity_params:
+ * @self: #GopalPCSSEP instance
+ * @threshold: the speech level, in dBFS
+ * @crossings: zero crossings per sample over which quieter frames,
+ * up to 10 dB under @threshold, are speech too
+ * @hangover: milliseconds still sent after the speech
+ *
+ * Tunes the voice activity detection. The defaults are -45 dBFS,
+ * 0.25 crossings per sample and 200 ms.
+ */
+void
+gopal_pcss_ep_set_voice_activity_params (GopalPCSSEP *self,
+                                         gdouble threshold,
+                                         gdouble crossings,
+                                         guint hangover)
+{
+    mm_backend_set_voice_activity_params (threshold, crossings, hangover);
+}
+
+/**
+ * gopal_pcss_ep_set_soundchannel_record_depth:
+ * @self: #GopalPCSSEP instance
+ * @ms: milliseconds of captured audio to keep, or 0 to follow the
+ * buffers of Opal
+ *
+ * Sets how much audio captured by the "Gst" sound channel may wait
+ * for Opal before the oldest is dropped. Each loss is counted in
+ * "read-dropped", and its time kept in "read-drop-times", by
+ * gopal_pcss_ep_get_audio_stats().
+ */
+void
+gopal_pcss_ep_set_soundchannel_record_depth (GopalPCSSEP *self, guint ms)
+{
+    mm_backend_set_capture_depth (ms);
+}
+
+/**
+ * gopal_pcss_ep_get_soundchannel_record_depth:
+ * @self: #GopalPCSSEP instance
+ *
+ * Returns: the milliseconds of captured audio kept, 0 if they follow
+ * the buffers of Opal
+ */
+guint
+gopal_pcss_ep_get_soundchannel_record_depth (GopalPCSSEP *self)
+{
+    return mm_backend_get_capture_depth ();
+}
+
+/**
+ * gopal_pcss_ep_set_soundchannel_idle_policy:
+ * @self: #GopalPCSSEP instance
+ * @policy: what to do with the pipelines between calls
+ *
+ * Once the last sound channel of a call closes, the "Gst" sound
+ * channel tears its pipelines down, parks them in READY with the
+ * devices closed, or keeps them warm, the default, for the next call
+ * to start at once. Only in the last case does an idle phone keep the
+ * sound devices open.
+ */
+void
+gopal_pcss_ep_set_soundchannel_idle_policy (GopalPCSSEP *self,
+                                            GopalSoundChannelIdle policy)
+{
+    mm_backend_set_idle_policy ((MmBackendIdlePolicy) policy);
+}
+
+/**
+ * gopal_pcss_ep_get_soundchannel_idle_policy:
+ * @self: #GopalPCSSEP instance
+ *
+ * Returns: what the "Gst" sound channel does with its pipelines
+ * between calls
+ */
+GopalSoundChannelIdle
+gopal_pcss_ep_get_soundchannel_idle_policy (GopalPCSSEP *self)
+{
+    return (GopalSoundChannelIdle) mm_backend_get_idle_policy ();
+}
+
+/**
+ * gopal_pcss_ep_set_soundchannel_realtime:
+ * @self: #GopalPCSSEP instance
+ * @policy: how to schedule the audio threads
+ * @priority: the SCHED_RR or SCHED_FIFO priority, 1 to 99, or the
+ * niceness, -20 to 0
+ *
+ * Raises the GStreamer streaming threads of the "Gst" sound channel,
+ * and the Opal threads reading and writing its audio, above the rest
+ * of the load, meant to keep a busy desktop from making the calls
+ * glitch. It is off by default. The real-time policies need the
+ * CAP_SYS_NICE capability or a high enough RLIMIT_RTPRIO; when they
+ * are not allowed the threads are only given a lower niceness.
+ *
+ * It applies from the next call; going back to
+ * %GOPAL_SOUND_CHANNEL_REALTIME_NONE gives the reused threads back the
+ * scheduling of the process. See
+ * gopal_pcss_ep_get_call_deadline_misses() to measure it.
+ */
+void
+gopal_pcss_ep_set_soundchannel_realtime (GopalPCSSEP *self,
+                                         GopalSoundChannelRealtime policy,
+                                         gint priority)
+{
+    mm_backend_set_realtime ((MmBackendRealtime) policy, priority);
+}
+
+/**
+ * gopal_pcss_ep_get_soundchannel_realtime:
+ * @self: #GopalPCSSEP instance
+ *
+ * Returns: how the audio threads of the "Gst" sound channel are
+ * scheduled
+ */
+GopalSoundChannelRealtime
+gopal_pcss_ep_get_soundchannel_realtime (GopalPCSSEP *self)
+{
+    return (GopalSoundChannelRealtime) mm_backend_get_realtime (NULL);
+}
+
+/**
+ * gopal_pcss_ep_set_soundchannel_cpus:
+ * @self: #GopalPCSSEP instance
+ * @cpus: (allow-none): the CPUs, such as "2,3" or "2-3", or %NULL for
+ * any
+ *
+ * Pins the audio threads of the "Gst" sound channel to @cpus, from the
+ * next call.
+ *
+ * Returns: %FALSE if @cpus is not a list of CPUs
+ */
+gboolean
+gopal_pcss_ep_set_soundchannel_cpus (GopalPCSSEP *self, const gchar *cpus)
+{
+    return mm_backend_set_cpu_affinity (cpus);
+}
+
+/**
+ * gopal_pcss_ep_get_call_deadline_misses:
+ * @self: #GopalPCSSEP instance
+ * @token: the token of the call
+ *
+ * Counts, while the call has its media open, the audio buffers the
+ * streaming threads of its "Gst" sound channels handed over a whole
+ * buffer late although they had audio to move. It is the measure of
+ * gopal_pcss_ep_set_soundchannel_realtime().
+ *
+ * Returns: the deadline misses of the call
+ */
+guint64
+gopal_pcss_ep_get_call_deadline_misses (GopalPCSSEP *self,
+                                        const gchar *token)
+{
+    return sound_channel_get_deadline_misses (token);
+}
+
 G_END_DECLS
@@ -29,6 +29,36 @@ G_BEGIN_DECLS
 #define GOPAL_PCSS_EP_GET_CLASS(obj)	\
     (G_TYPE_INSTANCE_GET_CLASS((obj),  GOPAL_TYPE_PCSS_EP, GopalPCSSEPClass))
 
+/**
+ * GopalSoundChannelIdle:
+ * @GOPAL_SOUND_CHANNEL_IDLE_TEARDOWN: shut the pipelines down
+ * @GOPAL_SOUND_CHANNEL_IDLE_READY: keep them built, with the devices closed
+ * @GOPAL_SOUND_CHANNEL_IDLE_WARM: keep them prerolled, with the devices open
+ *
+ * What the "Gst" sound channel does with its pipelines between calls.
+ */
+typedef enum {
+    GOPAL_SOUND_CHANNEL_IDLE_TEARDOWN,
+    GOPAL_SOUND_CHANNEL_IDLE_READY,
+    GOPAL_SOUND_CHANNEL_IDLE_WARM
+} GopalSoundChannelIdle;
+
+/**
+ * GopalSoundChannelRealtime:
+ * @GOPAL_SOUND_CHANNEL_REALTIME_NONE: leave the audio threads alone
+ * @GOPAL_SOUND_CHANNEL_REALTIME_NICE: raise their niceness
+ * @GOPAL_SOUND_CHANNEL_REALTIME_RR: run them in SCHED_RR
+ * @GOPAL_SOUND_CHANNEL_REALTIME_FIFO: run them in SCHED_FIFO
+ *
+ * How the "Gst" sound channel schedules the threads moving the audio.
+ */
+typedef enum {
+    GOPAL_SOUND_CHANNEL_REALTIME_NONE,
+    GOPAL_SOUND_CHANNEL_REALTIME_NICE,
+    GOPAL_SOUND_CHANNEL_REALTIME_RR,
+    GOPAL_SOUND_CHANNEL_REALTIME_FIFO
+} GopalSoundChannelRealtime;
+
 typedef struct _GopalPCSSEPPrivate GopalPCSSEPPrivate;
 typedef struct _GopalPCSSEP GopalPCSSEP;
 typedef struct _GopalPCSSEPClass GopalPCSSEPClass;
@@ -61,6 +91,22 @@ gopal_pcss_ep_set_soundchannel_record_device   (GopalPCSSEP *self,
 const gchar *
 gopal_pcss_ep_get_soundchannel_record_device   (GopalPCSSEP *self);
 
+gchar **
+gopal_pcss_ep_list_soundchannel_play_devices   (GopalPCSSEP *self);
+
+gchar **
+gopal_pcss_ep_list_soundchannel_record_devices (GopalPCSSEP *self);
+
+gboolean
+gopal_pcss_ep_switch_soundchannel_play_device  (GopalPCSSEP *self,
+						const gchar *token,
+						const gchar *name);
+
+gboolean
+gopal_pcss_ep_switch_soundchannel_record_device (GopalPCSSEP *self,
+						 const gchar *token,
+						 const gchar *name);
+
 void
 gopal_pcss_ep_set_soundchannel_buffer_time     (GopalPCSSEP *self,
 						guint depth);
@@ -77,6 +123,117 @@ gopal_pcss_ep_reject_incoming_connection       (GopalPCSSEP *self,
                                                 const gchar *token,
                                                 GopalCallEndReason reason);
 
+void
+gopal_pcss_ep_set_duplex_audio                 (GopalPCSSEP *self,
+                                                gboolean duplex);
+
+gboolean
+gopal_pcss_ep_get_duplex_audio                 (GopalPCSSEP *self);
+
+void
+gopal_pcss_ep_set_conference_audio             (GopalPCSSEP *self,
+                                                gboolean conference);
+
+gboolean
+gopal_pcss_ep_get_conference_audio             (GopalPCSSEP *self);
+
+gboolean
+gopal_pcss_ep_set_soundchannel_play_element    (GopalPCSSEP *self,
+                                                const gchar *description);
+
+gboolean
+gopal_pcss_ep_set_soundchannel_record_element  (GopalPCSSEP *self,
+                                                const gchar *description);
+
+void
+gopal_pcss_ep_set_soundchannel_play_timing     (GopalPCSSEP *self,
+                                                gint64 latency_time,
+                                                gint64 buffer_time);
+
+void
+gopal_pcss_ep_set_soundchannel_record_timing   (GopalPCSSEP *self,
+                                                gint64 latency_time,
+                                                gint64 buffer_time);
+
+gint64
+gopal_pcss_ep_get_soundchannel_play_latency    (GopalPCSSEP *self);
+
+gint64
+gopal_pcss_ep_get_soundchannel_record_latency  (GopalPCSSEP *self);
+
+GVariant *
+gopal_pcss_ep_get_audio_stats                  (GopalPCSSEP *self);
+
+void
+gopal_pcss_ep_set_soundchannel_play_mute       (GopalPCSSEP *self,
+                                                gboolean mute);
+
+gboolean
+gopal_pcss_ep_get_soundchannel_play_mute       (GopalPCSSEP *self);
+
+void
+gopal_pcss_ep_set_soundchannel_record_mute     (GopalPCSSEP *self,
+                                                gboolean mute);
+
+gboolean
+gopal_pcss_ep_get_soundchannel_record_mute     (GopalPCSSEP *self);
+
+void
+gopal_pcss_ep_set_soundchannel_play_gain       (GopalPCSSEP *self,
+                                                gdouble gain);
+
+gdouble
+gopal_pcss_ep_get_soundchannel_play_gain       (GopalPCSSEP *self);
+
+void
+gopal_pcss_ep_set_soundchannel_record_gain     (GopalPCSSEP *self,
+                                                gdouble gain);
+
+gdouble
+gopal_pcss_ep_get_soundchannel_record_gain     (GopalPCSSEP *self);
+
+void
+gopal_pcss_ep_set_voice_activity_detection     (GopalPCSSEP *self,
+                                                gboolean enable);
+
+gboolean
+gopal_pcss_ep_get_voice_activity_detection     (GopalPCSSEP *self);
+
+void
+gopal_pcss_ep_set_voice_activity_params        (GopalPCSSEP *self,
+                                                gdouble threshold,
+                                                gdouble crossings,
+                                                guint hangover);
+
+void
+gopal_pcss_ep_set_soundchannel_record_depth    (GopalPCSSEP *self,
+                                                guint ms);
+
+guint
+gopal_pcss_ep_get_soundchannel_record_depth    (GopalPCSSEP *self);
+
+void
+gopal_pcss_ep_set_soundchannel_idle_policy     (GopalPCSSEP *self,
+                                                GopalSoundChannelIdle policy);
+
+GopalSoundChannelIdle
+gopal_pcss_ep_get_soundchannel_idle_policy     (GopalPCSSEP *self);
+
+void
+gopal_pcss_ep_set_soundchannel_realtime        (GopalPCSSEP *self,
+                                                GopalSoundChannelRealtime policy,
+                                                gint priority);
+
+GopalSoundChannelRealtime
+gopal_pcss_ep_get_soundchannel_realtime        (GopalPCSSEP *self);
+
+gboolean
+gopal_pcss_ep_set_soundchannel_cpus            (GopalPCSSEP *self,
+                                                const gchar *cpus);
+
+guint64
+gopal_pcss_ep_get_call_deadline_misses         (GopalPCSSEP *self,
+                                                const gchar *token);
 
 G_END_DECLS
 
@@ -0,0 +1,655 @@
+/*
+ * Copyright (C) 2026 Igalia S.L.
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#include "mmaudio.h"
+
+#include <math.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* frames converted at once before the channel mapping */
+#define CHUNK_FRAMES 128
+
+static gboolean use_simd = TRUE;
+
+MmAudioFormat
+mm_audio_format_from_string (const gchar *format)
+{
+    if (g_strcmp0 (format, "S16LE") == 0)
+        return MM_AUDIO_FORMAT_S16;
+    if (g_strcmp0 (format, "S24LE") == 0)
+        return MM_AUDIO_FORMAT_S24;
+    if (g_strcmp0 (format, "S32LE") == 0)
+        return MM_AUDIO_FORMAT_S32;
+    if (g_strcmp0 (format, "F32LE") == 0)
+        return MM_AUDIO_FORMAT_F32;
+
+    return MM_AUDIO_FORMAT_UNKNOWN;
+}
+
+/* bytes per sample */
+guint
+mm_audio_format_width (MmAudioFormat format)
+{
+    switch (format) {
+    case MM_AUDIO_FORMAT_S16:
+        return 2;
+    case MM_AUDIO_FORMAT_S24:
+        return 3;
+    case MM_AUDIO_FORMAT_S32:
+    case MM_AUDIO_FORMAT_F32:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+/* scalar kernels: they also handle the tails of the vector ones */
+
+static void
+s24_to_s16 (gint16 *dest, const guint8 *src, gsize samples)
+{
+    gsize i;
+
+    /* the two most significant bytes */
+    for (i = 0; i < samples; i++, src += 3)
+        dest[i] = (gint16) (src[1] | (src[2] << 8));
+}
+
+static void
+s32_to_s16_scalar (gint16 *dest, const gint32 *src, gsize samples)
+{
+    gsize i;
+
+    for (i = 0; i < samples; i++)
+        dest[i] = src[i] >> 16;
+}
+
+static void
+f32_to_s16_scalar (gint16 *dest, const gfloat *src, gsize samples)
+{
+    gsize i;
+
+    for (i = 0; i < samples; i++) {
+        glong v = lrintf (src[i] * 32767.0f);
+        dest[i] = CLAMP (v, G_MININT16, G_MAXINT16);
+    }
+}
+
+static void
+downmix_scalar (gint16 *dest, const gint16 *src, gsize frames)
+{
+    gsize i;
+
+    for (i = 0; i < frames; i++)
+        dest[i] = (src[2 * i] + src[2 * i + 1]) >> 1;
+}
+
+static void
+upmix_scalar (gint16 *dest, const gint16 *src, gsize frames)
+{
+    gsize i;
+
+    for (i = 0; i < frames; i++)
+        dest[2 * i] = dest[2 * i + 1] = src[i];
+}
+
+static void
+gain_scalar (gint16 *samples, gsize count, gint gain)
+{
+    gsize i;
+
+    for (i = 0; i < count; i++) {
+        gint32 v = (samples[i] * gain) >> MM_AUDIO_GAIN_SHIFT;
+        samples[i] = CLAMP (v, G_MININT16, G_MAXINT16);
+    }
+}
+
+/* halved samples: two squares always fit in a signed 32 bits lane */
+static guint64
+energy_scalar (const gint16 *samples, gsize count)
+{
+    guint64 sum = 0;
+    gsize i;
+
+    for (i = 0; i < count; i++) {
+        gint32 v = samples[i] >> 1;
+        sum += v * v;
+    }
+
+    return sum;
+}
+
+static guint
+crossings_scalar (const gint16 *samples, gsize count)
+{
+    guint n = 0;
+    gsize i;
+
+    for (i = 1; i < count; i++)
+        n += (samples[i - 1] ^ samples[i]) < 0;
+
+    return n;
+}
+
+static void
+accumulate_scalar (gint32 *acc, const gint16 *samples, gsize count)
+{
+    gsize i;
+
+    for (i = 0; i < count; i++)
+        acc[i] += samples[i];
+}
+
+static void
+mix_minus_scalar (gint16 *dest, const gint32 *acc, const gint16 *samples,
+                  gsize count)
+{
+    gsize i;
+
+    for (i = 0; i < count; i++) {
+        gint32 v = acc[i] - (samples ? samples[i] : 0);
+        dest[i] = CLAMP (v, G_MININT16, G_MAXINT16);
+    }
+}
+
+static void
+mix_scalar (gint16 *dest, const gint16 *samples, gsize count)
+{
+    gsize i;
+
+    for (i = 0; i < count; i++) {
+        gint32 v = dest[i] + samples[i];
+        dest[i] = CLAMP (v, G_MININT16, G_MAXINT16);
+    }
+}
+
+#ifdef __SSE2__
+
+/* the vector kernels give the very same results as the scalar ones */
+
+static void
+s32_to_s16_sse2 (gint16 *dest, const gint32 *src, gsize samples)
+{
+    gsize i;
+
+    for (i = 0; i + 8 <= samples; i += 8) {
+        __m128i a = _mm_loadu_si128 ((const __m128i *) (src + i));
+        __m128i b = _mm_loadu_si128 ((const __m128i *) (src + i + 4));
+
+        a = _mm_srai_epi32 (a, 16);
+        b = _mm_srai_epi32 (b, 16);
+        _mm_storeu_si128 ((__m128i *) (dest + i), _mm_packs_epi32 (a, b));
+    }
+
+    s32_to_s16_scalar (dest + i, src + i, samples - i);
+}
+
+/* Four packed samples are spread out to a 32-bit lane each, from where
+ * the two bytes kept are shifted down with their sign. Each 16-byte
+ * load reads 4 bytes past its four samples. */
+static inline __m128i
+s24_unpack4_sse2 (const guint8 *src)
+{
+    __m128i v = _mm_loadu_si128 ((const __m128i *) src);
+    __m128i s01 = _mm_unpacklo_epi32 (v, _mm_srli_si128 (v, 3));
+    __m128i s23 = _mm_unpacklo_epi32 (_mm_srli_si128 (v, 6),
+                                      _mm_srli_si128 (v, 9));
+    __m128i s = _mm_unpacklo_epi64 (s01, s23);
+
+    return _mm_srai_epi32 (_mm_slli_epi32 (s, 8), 16);
+}
+
+static void
+s24_to_s16_sse2 (gint16 *dest, const guint8 *src, gsize samples)
+{
+    gsize i;
+
+    /* the loads of the last 8 samples would read past the buffer */
+    for (i = 0; i + 10 <= samples; i += 8) {
+        __m128i a = s24_unpack4_sse2 (src + i * 3);
+        __m128i b = s24_unpack4_sse2 (src + i * 3 + 12);
+
+        _mm_storeu_si128 ((__m128i *) (dest + i), _mm_packs_epi32 (a, b));
+    }
+
+    s24_to_s16 (dest + i, src + i * 3, samples - i);
+}
+
+static void
+f32_to_s16_sse2 (gint16 *dest, const gfloat *src, gsize samples)
+{
+    const __m128 scale = _mm_set1_ps (32767.0f);
+    gsize i;
+
+    /* cvtps rounds to nearest as lrintf, packs saturates as CLAMP */
+    for (i = 0; i + 8 <= samples; i += 8) {
+        __m128 a = _mm_loadu_ps (src + i);
+        __m128 b = _mm_loadu_ps (src + i + 4);
+        __m128i ia = _mm_cvtps_epi32 (_mm_mul_ps (a, scale));
+        __m128i ib = _mm_cvtps_epi32 (_mm_mul_ps (b, scale));
+
+        _mm_storeu_si128 ((__m128i *) (dest + i), _mm_packs_epi32 (ia, ib));
+    }
+
+    f32_to_s16_scalar (dest + i, src + i, samples - i);
+}
+
+static void
+downmix_sse2 (gint16 *dest, const gint16 *src, gsize frames)
+{
+    const __m128i ones = _mm_set1_epi16 (1);
+    gsize i;
+
+    /* madd adds each left and right pair into 32 bits */
+    for (i = 0; i + 8 <= frames; i += 8) {
+        __m128i a = _mm_loadu_si128 ((const __m128i *) (src + 2 * i));
+        __m128i b = _mm_loadu_si128 ((const __m128i *) (src + 2 * i + 8));
+
+        a = _mm_srai_epi32 (_mm_madd_epi16 (a, ones), 1);
+        b = _mm_srai_epi32 (_mm_madd_epi16 (b, ones), 1);
+        _mm_storeu_si128 ((__m128i *) (dest + i), _mm_packs_epi32 (a, b));
+    }
+
+    downmix_scalar (dest + i, src + 2 * i, frames - i);
+}
+
+static void
+upmix_sse2 (gint16 *dest, const gint16 *src, gsize frames)
+{
+    gsize i;
+
+    for (i = 0; i + 8 <= frames; i += 8) {
+        __m128i a = _mm_loadu_si128 ((const __m128i *) (src + i));
+
+        _mm_storeu_si128 ((__m128i *) (dest + 2 * i), _mm_unpacklo_epi16 (a, a));
+        _mm_storeu_si128 ((__m128i *) (dest + 2 * i + 8), _mm_unpackhi_epi16 (a, a));
+    }
+
+    upmix_scalar (dest + 2 * i, src + i, frames - i);
+}
+
+static void
+gain_sse2 (gint16 *samples, gsize count, gint gain)
+{
+    const __m128i g = _mm_set1_epi16 (gain);
+    gsize i;
+
+    /* the full 32 bits products, shifted back and packed saturating */
+    for (i = 0; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128 ((const __m128i *) (samples + i));
+        __m128i lo = _mm_mullo_epi16 (v, g);
+        __m128i hi = _mm_mulhi_epi16 (v, g);
+        __m128i a = _mm_srai_epi32 (_mm_unpacklo_epi16 (lo, hi),
+                                    MM_AUDIO_GAIN_SHIFT);
+        __m128i b = _mm_srai_epi32 (_mm_unpackhi_epi16 (lo, hi),
+                                    MM_AUDIO_GAIN_SHIFT);
+
+        _mm_storeu_si128 ((__m128i *) (samples + i), _mm_packs_epi32 (a, b));
+    }
+
+    gain_scalar (samples + i, count - i, gain);
+}
+
+static guint64
+energy_sse2 (const gint16 *samples, gsize count)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    __m128i acc = zero;
+    guint64 sums[2];
+    gsize i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128 ((const __m128i *) (samples + i));
+        __m128i sq;
+
+        v = _mm_srai_epi16 (v, 1);
+        sq = _mm_madd_epi16 (v, v);
+        acc = _mm_add_epi64 (acc, _mm_unpacklo_epi32 (sq, zero));
+        acc = _mm_add_epi64 (acc, _mm_unpackhi_epi32 (sq, zero));
+    }
+
+    _mm_storeu_si128 ((__m128i *) sums, acc);
+
+    return sums[0] + sums[1] + energy_scalar (samples + i, count - i);
+}
+
+static guint
+crossings_sse2 (const gint16 *samples, gsize count)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    guint n = 0;
+    gsize i;
+
+    /* each sample against the previous one: the sign of their xor */
+    for (i = 1; i + 8 <= count; i += 8) {
+        __m128i cur = _mm_loadu_si128 ((const __m128i *) (samples + i));
+        __m128i prev = _mm_loadu_si128 ((const __m128i *) (samples + i - 1));
+        __m128i sign = _mm_cmplt_epi16 (_mm_xor_si128 (cur, prev), zero);
+
+        n += __builtin_popcount (_mm_movemask_epi8 (sign)) / 2;
+    }
+
+    return n + crossings_scalar (samples + i - 1, count - i + 1);
+}
+
+/* the samples sign extended by unpacking them into the high halves */
+static void
+accumulate_sse2 (gint32 *acc, const gint16 *samples, gsize count)
+{
+    gsize i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128 ((const __m128i *) (samples + i));
+        __m128i lo = _mm_srai_epi32 (_mm_unpacklo_epi16 (v, v), 16);
+        __m128i hi = _mm_srai_epi32 (_mm_unpackhi_epi16 (v, v), 16);
+        __m128i a = _mm_loadu_si128 ((const __m128i *) (acc + i));
+        __m128i b = _mm_loadu_si128 ((const __m128i *) (acc + i + 4));
+
+        _mm_storeu_si128 ((__m128i *) (acc + i), _mm_add_epi32 (a, lo));
+        _mm_storeu_si128 ((__m128i *) (acc + i + 4), _mm_add_epi32 (b, hi));
+    }
+
+    accumulate_scalar (acc + i, samples + i, count - i);
+}
+
+static void
+mix_minus_sse2 (gint16 *dest, const gint32 *acc, const gint16 *samples,
+                gsize count)
+{
+    gsize i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        __m128i a = _mm_loadu_si128 ((const __m128i *) (acc + i));
+        __m128i b = _mm_loadu_si128 ((const __m128i *) (acc + i + 4));
+
+        if (samples) {
+            __m128i v = _mm_loadu_si128 ((const __m128i *) (samples + i));
+
+            a = _mm_sub_epi32 (a, _mm_srai_epi32 (_mm_unpacklo_epi16 (v, v), 16));
+            b = _mm_sub_epi32 (b, _mm_srai_epi32 (_mm_unpackhi_epi16 (v, v), 16));
+        }
+
+        _mm_storeu_si128 ((__m128i *) (dest + i), _mm_packs_epi32 (a, b));
+    }
+
+    mix_minus_scalar (dest + i, acc + i, samples ? samples + i : NULL,
+                      count - i);
+}
+
+static void
+mix_sse2 (gint16 *dest, const gint16 *samples, gsize count)
+{
+    gsize i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        __m128i a = _mm_loadu_si128 ((const __m128i *) (dest + i));
+        __m128i b = _mm_loadu_si128 ((const __m128i *) (samples + i));
+
+        _mm_storeu_si128 ((__m128i *) (dest + i), _mm_adds_epi16 (a, b));
+    }
+
+    mix_scalar (dest + i, samples + i, count - i);
+}
+
+#endif /* __SSE2__ */
+
+static void
+to_s16 (gint16 *dest, const guint8 *src, MmAudioFormat format, gsize samples)
+{
+    switch (format) {
+    case MM_AUDIO_FORMAT_S16:
+        memcpy (dest, src, samples * 2);
+        break;
+    case MM_AUDIO_FORMAT_S24:
+#ifdef __SSE2__
+        if (use_simd) {
+            s24_to_s16_sse2 (dest, src, samples);
+            break;
+        }
+#endif
+        s24_to_s16 (dest, src, samples);
+        break;
+    case MM_AUDIO_FORMAT_S32:
+#ifdef __SSE2__
+        if (use_simd) {
+            s32_to_s16_sse2 (dest, (const gint32 *) src, samples);
+            break;
+        }
+#endif
+        s32_to_s16_scalar (dest, (const gint32 *) src, samples);
+        break;
+    case MM_AUDIO_FORMAT_F32:
+#ifdef __SSE2__
+        if (use_simd) {
+            f32_to_s16_sse2 (dest, (const gfloat *) src, samples);
+            break;
+        }
+#endif
+        f32_to_s16_scalar (dest, (const gfloat *) src, samples);
+        break;
+    default:
+        memset (dest, 0, samples * 2);
+        break;
+    }
+}
+
+static void
+remix (gint16 *dest, guint dest_channels,
+       const gint16 *src, guint src_channels,
+       gsize frames)
+{
+    if (src_channels == 2 && dest_channels == 1) {
+#ifdef __SSE2__
+        if (use_simd) {
+            downmix_sse2 (dest, src, frames);
+            return;
+        }
+#endif
+        downmix_scalar (dest, src, frames);
+    } else {
+#ifdef __SSE2__
+        if (use_simd) {
+            upmix_sse2 (dest, src, frames);
+            return;
+        }
+#endif
+        upmix_scalar (dest, src, frames);
+    }
+}
+
+/**
+ * mm_audio_convert:
+ * @dest: where to write @frames frames of S16 audio
+ * @dest_channels: channels of @dest, 1 or 2
+ * @src: the audio to convert
+ * @format: the sample format of @src
+ * @src_channels: channels of @src, 1 or 2
+ * @frames: frames to convert
+ *
+ * Converts interleaved audio to S16, downmixing stereo to mono by
+ * averaging, or duplicating mono into both channels.
+ */
+void
+mm_audio_convert (gint16 *dest,
+                  guint dest_channels,
+                  const guint8 *src,
+                  MmAudioFormat format,
+                  guint src_channels,
+                  gsize frames)
+{
+    gint16 tmp[CHUNK_FRAMES * 2];
+    guint width = mm_audio_format_width (format);
+    gsize n;
+
+    g_return_if_fail (dest_channels == 1 || dest_channels == 2);
+    g_return_if_fail (src_channels == 1 || src_channels == 2);
+
+    if (src_channels == dest_channels) {
+        to_s16 (dest, src, format, frames * src_channels);
+        return;
+    }
+
+    /* a 16 bits source needs no conversion before the remix */
+    if (format == MM_AUDIO_FORMAT_S16) {
+        remix (dest, dest_channels, (const gint16 *) src, src_channels, frames);
+        return;
+    }
+
+    while (frames > 0) {
+        n = MIN (frames, CHUNK_FRAMES);
+
+        to_s16 (tmp, src, format, n * src_channels);
+        remix (dest, dest_channels, tmp, src_channels, n);
+
+        dest += n * dest_channels;
+        src += n * src_channels * width;
+        frames -= n;
+    }
+}
+
+/**
+ * mm_audio_apply_gain:
+ * @samples: S16 audio
+ * @count: number of samples
+ * @gain: the gain, from 0 to %MM_AUDIO_GAIN_MAX, %MM_AUDIO_GAIN_UNITY
+ * meaning 1
+ *
+ * Multiplies @samples in place by @gain, saturating.
+ */
+void
+mm_audio_apply_gain (gint16 *samples, gsize count, gint gain)
+{
+    if (gain == MM_AUDIO_GAIN_UNITY)
+        return;
+
+    if (gain <= 0) {
+        memset (samples, 0, count * 2);
+        return;
+    }
+
+    gain = MIN (gain, MM_AUDIO_GAIN_MAX);
+
+#ifdef __SSE2__
+    if (use_simd) {
+        gain_sse2 (samples, count, gain);
+        return;
+    }
+#endif
+    gain_scalar (samples, count, gain);
+}
+
+/**
+ * mm_audio_energy:
+ * @samples: S16 audio
+ * @count: number of samples
+ * @crossings: (out): number of sign changes between consecutive samples
+ *
+ * Measures @samples for the voice activity detection.
+ *
+ * Returns: the sum of the squares of the samples halved, so the energy
+ * of a full scale sample is 2^28
+ */
+guint64
+mm_audio_energy (const gint16 *samples, gsize count, guint *crossings)
+{
+    if (count == 0) {
+        *crossings = 0;
+        return 0;
+    }
+
+#ifdef __SSE2__
+    if (use_simd) {
+        *crossings = crossings_sse2 (samples, count);
+        return energy_sse2 (samples, count);
+    }
+#endif
+    *crossings = crossings_scalar (samples, count);
+    return energy_scalar (samples, count);
+}
+
+/**
+ * mm_audio_accumulate:
+ * @acc: the 32 bits sum of the audio mixed so far
+ * @samples: S16 audio to add to it
+ * @count: number of samples
+ *
+ * Adds @samples to @acc. With 32 bits there is room for 65536 full
+ * scale sources before the sum can overflow, so nothing saturates
+ * until mm_audio_mix_minus().
+ */
+void
+mm_audio_accumulate (gint32 *acc, const gint16 *samples, gsize count)
+{
+#ifdef __SSE2__
+    if (use_simd) {
+        accumulate_sse2 (acc, samples, count);
+        return;
+    }
+#endif
+    accumulate_scalar (acc, samples, count);
+}
+
+/**
+ * mm_audio_mix_minus:
+ * @dest: where to write @count S16 samples
+ * @acc: the 32 bits sum of the mixed audio
+ * @samples: (allow-none): S16 audio to leave out of the mix
+ * @count: number of samples
+ *
+ * Writes the mix in @acc, without @samples, saturated to S16. This is
+ * what a party of a conference hears: everybody else.
+ */
+void
+mm_audio_mix_minus (gint16 *dest, const gint32 *acc, const gint16 *samples,
+                    gsize count)
+{
+#ifdef __SSE2__
+    if (use_simd) {
+        mix_minus_sse2 (dest, acc, samples, count);
+        return;
+    }
+#endif
+    mix_minus_scalar (dest, acc, samples, count);
+}
+
+/**
+ * mm_audio_mix:
+ * @dest: S16 audio
+ * @samples: S16 audio to add to it
+ * @count: number of samples
+ *
+ * Adds @samples to @dest in place, saturating.
+ */
+void
+mm_audio_mix (gint16 *dest, const gint16 *samples, gsize count)
+{
+#ifdef __SSE2__
+    if (use_simd) {
+        mix_sse2 (dest, samples, count);
+        return;
+    }
+#endif
+    mix_scalar (dest, samples, count);
+}
+
+/**
+ * mm_audio_set_simd:
+ * @enable: whether to use the vector kernels
+ *
+ * Forces the scalar kernels, to compare them with the vector ones.
+ * The vector kernels are used by default when the CPU has them.
+ */
+void
+mm_audio_set_simd (gboolean enable)
+{
+    use_simd = enable;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2026 Igalia S.L.
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#ifndef MM_AUDIO_H
+#define MM_AUDIO_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* interleaved, little endian, sample formats a device may deliver */
+typedef enum {
+    MM_AUDIO_FORMAT_UNKNOWN,
+    MM_AUDIO_FORMAT_S16,
+    MM_AUDIO_FORMAT_S24,    /* packed in 3 bytes */
+    MM_AUDIO_FORMAT_S32,
+    MM_AUDIO_FORMAT_F32
+} MmAudioFormat;
+
+/* gains are fixed point, with 12 fractional bits */
+#define MM_AUDIO_GAIN_SHIFT 12
+#define MM_AUDIO_GAIN_UNITY (1 << MM_AUDIO_GAIN_SHIFT)
+#define MM_AUDIO_GAIN_MAX   G_MAXINT16
+
+MmAudioFormat
+mm_audio_format_from_string                     (const gchar *format);
+
+guint
+mm_audio_format_width                           (MmAudioFormat format);
+
+void
+mm_audio_convert                                (gint16 *dest,
+                                                 guint dest_channels,
+                                                 const guint8 *src,
+                                                 MmAudioFormat format,
+                                                 guint src_channels,
+                                                 gsize frames);
+
+void
+mm_audio_apply_gain                             (gint16 *samples,
+                                                 gsize count,
+                                                 gint gain);
+
+guint64
+mm_audio_energy                                 (const gint16 *samples,
+                                                 gsize count,
+                                                 guint *crossings);
+
+void
+mm_audio_accumulate                             (gint32 *acc,
+                                                 const gint16 *samples,
+                                                 gsize count);
+
+void
+mm_audio_mix_minus                              (gint16 *dest,
+                                                 const gint32 *acc,
+                                                 const gint16 *samples,
+                                                 gsize count);
+
+void
+mm_audio_mix                                    (gint16 *dest,
+                                                 const gint16 *samples,
+                                                 gsize count);
+
+void
+mm_audio_set_simd                               (gboolean enable);
+
+G_END_DECLS
+
+#endif /* MM_AUDIO_H */
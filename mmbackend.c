@@ -9,13 +9,44 @@
  */
 
 #include "mmbackend.h"
+#include "mmaudio.h"
+#include "mmring.h"
 
 #include <gst/gst.h>
 #include <gst/app/gstappsrc.h>
 #include <gst/app/gstappsink.h>
-#include <gst/base/gstadapter.h>
 
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+typedef struct {
+    guint rate;
+    guint bpf; /* bytes per audio frame (all the channels) */
+} AudioFormat;
+
+typedef struct {
+    gsize size;
+    guint count;
+} BufferConfig;
+
+typedef struct {
+    gchar *description;   /* NULL for the automatic device */
+    gint64 latency_time;  /* microseconds, 0 for the element default */
+    gint64 buffer_time;   /* microseconds, 0 for the element default */
+} DeviceConfig;
+
+typedef enum {
+    PIPELINE_PLAYER,
+    PIPELINE_RECORDER,
+    PIPELINE_DUPLEX,
+    PIPELINE_LAST
+} PipelineKind;
 
 struct _MmBackendPrivate
 {
@@ -24,10 +55,224 @@ struct _MmBackendPrivate
 
     GstAppSrc *appsrc;   /* player */
     GstAppSink *appsink; /* recorder */
+    GstElement *queue;   /* player, leaky playout queue */
+
+    /* lock-free hand-off with Opal, by MmBackendDirection: the audio
+     * of the player, references to the captured buffers of the
+     * recorder */
+    MmRing *ring[2];
+
+    AudioFormat format[2];   /* indexed by MmBackendDirection */
+    BufferConfig buffers[2]; /* indexed by MmBackendDirection */
+    GSource *watch[2];       /* bus watches, by MmBackendDirection,
+                              * shared in duplex mode */
+    GMutex switch_lock;      /* held while a device is switched or closed */
+    gint failed[2];          /* atomic, the pipeline posted an error */
+
+    gboolean duplex;         /* one pipeline for both directions */
+    PipelineKind kind;
+    gchar *device;           /* synthetic device, NULL for the real one */
+
+    gint64 opened_at[2];     /* monotonic time, by MmBackendDirection,
+                              * under the lock */
+    gint starting[2];        /* atomic, the first buffer is to come */
+    gint64 started_at[2];    /* the same, kept until PLAYING */
+    gint ready[2];           /* atomic, the pipeline reached PLAYING */
+    GstPad *render_pad;      /* player, audio sink pad */
+    gulong render_probe;
+
+    GstCaps *caps;       /* player */
+    GstBufferPool *pool; /* player */
+    gsize pool_size;
+
+    GMutex lock;
+    GCond cond;          /* signaled when a waiting reader gets data */
+    gint reader_waiting;
+    gint busy[2];        /* atomic, Opal threads reading or writing */
+    gint closing[2];     /* atomic, the direction is being closed */
+    gint held;           /* atomic, the call is on hold */
+    gint flush_capture;  /* atomic, the capture predates the hold */
+    gint64 playout_target;
+    gint64 max_latency;  /* 0 if derived from the buffers */
+
+    /* the latencies are updated under the lock, from the streaming
+     * and bus threads; the rest by the thread that owns them */
+    MmBackendStats stats;
+    guint64 written;           /* player, bytes from Opal in the ring */
+    guint64 pushed;            /* player, bytes from the ring to appsrc */
+    gint frame_size;           /* player, bytes per Opal frame */
+    gint starved;              /* player, the writer has to push */
+    gint push_ret;             /* player, last GstFlowReturn */
+    GstClockTime next_capture; /* recorder, expected timestamp */
+    gint64 vad_hangover;       /* recorder, speech still to send */
+
+    gboolean conference;       /* opens as a leg of the conference */
+    gboolean host;             /* runs the pipelines of the conference */
+    gboolean leg[2];           /* joined, by MmBackendDirection */
+    gint16 *leg_block;         /* player leg, its share of the mix */
+    MmRing *others;            /* recorder leg, the mix of the others */
+    gint16 *others_block;      /* recorder leg, read from others */
+    gsize others_size;
+    GstCaps *capture_caps;     /* recorder, negotiated by the device */
+    MmAudioFormat capture_format;
+    guint capture_channels;
+    GstBufferPool *capture_pool; /* recorder, for the conversions */
+    gsize capture_pool_size;
+    gsize capture_size;        /* recorder, bytes its ring may hold */
+    GstBuffer *capture_buffer; /* recorder, the one being read */
+    GstMapInfo capture_map;
+    gsize capture_offset;
+
+    /* updated from the streaming threads */
+    gint rendered;             /* player, offset at the sink, low bits */
+    gint written_low;          /* player, written, low bits */
+    gint write_dropped;
+    gint write_underruns;
+    gint capture_copies;
+    gint capture_dropped;
+    gint captured;             /* recorder, bytes queued in its ring */
+    GMutex drop_lock;          /* recorder, guards the drop times */
+    gint64 drop_times[MM_BACKEND_DROP_HISTORY];
+    guint drop_next;
+    gint render_latency[MM_BACKEND_LATENCY_BUCKETS];
+    gint render_latency_max;
+    gint deadline_misses;
+    gint64 last_buffer[2];     /* by MmBackendDirection, monotonic time */
+};
+
+/* buffers preallocated for the player: enough to cover the appsrc
+ * queue plus the one held by the sink */
+#define POOL_BUFFERS 8
+
+/* default depth, in microseconds, of the data queued in the player */
+#define PLAYOUT_TARGET (20 * G_TIME_SPAN_MILLISECOND)
+
+/* default ceiling, in microseconds, of the data queued in the player,
+ * until Opal sets the buffers */
+#define PLAYOUT_MAX_LATENCY (200 * G_TIME_SPAN_MILLISECOND)
+
+/* audio, in microseconds, each ring buffer can hold */
+#define RING_DURATION (500 * G_TIME_SPAN_MILLISECOND)
+
+/* captured buffers the recorder ring can hold, whatever their size */
+#define CAPTURE_REFS 256
+
+/* buffers preallocated for the capture converted to the call format.
+ * The pool grows if Opal lets more queue. */
+#define CAPTURE_POOL_BUFFERS 8
+
+/* pipelines kept, of each kind, between calls */
+#define CACHE_SIZE 2
+
+static GMutex cache_lock;
+static GQueue pipeline_cache[PIPELINE_LAST];
+
+/* atomic, a MmBackendIdlePolicy */
+static gint idle_policy = MM_BACKEND_IDLE_WARM;
+
+/* The scheduling of the streaming threads, guarded by realtime_lock.
+ * The threads take it as they start moving audio. The generation
+ * counts the changes, atomic too. */
+static GMutex realtime_lock;
+static gint realtime_generation;
+static MmBackendRealtime realtime_policy = MM_BACKEND_REALTIME_NONE;
+static gint realtime_priority;
+static gboolean realtime_pinned;
+static cpu_set_t realtime_cpus;
+
+/* the niceness used when the real-time priority is not allowed, as
+ * the lowest rtkit hands out */
+#define REALTIME_NICE -15
+
+/* in the Opal threads, the generation they were scheduled for */
+static GPrivate realtime_thread;
+
+/* devices that need no sound hardware, for headless testing */
+#define DEVICE_TEST "Gst:test"
+#define DEVICE_WAV  "Gst:wav="
+
+/* a device seen by the monitor, by its name */
+#define DEVICE_NAMED "Gst:dev="
+
+/* Guarded by devices_lock, indexed by MmBackendDirection: the names
+ * and the GstDevice of each. The bus thread replaces both arrays as a
+ * whole on hot-plug, so a reader only has to take a reference. */
+static GMutex devices_lock;
+static GPtrArray *device_names[2];
+static GPtrArray *device_objects[2];
+static GstDeviceMonitor *device_monitor;
+
+static const gchar *synthetic_devices[2][2] = {
+    /* recorder, player */
+    { "audiotestsrc is-live=true samplesperbuffer=160 volume=0.1",
+      "fakesink sync=true" },
+    { "filesrc name=file ! wavparse ! audioconvert ! audioresample",
+      "wavenc ! filesink name=file sync=true" },
+};
+
+/* every live backend, and the counters of the finalized ones */
+static GMutex stats_lock;
+static GList *backends = NULL;
+static MmBackendStats retired_stats;
 
-    GstAdapter *adapter_sink; /* adapter for appsink */
+/* atomic, indexed by MmBackendDirection: they take effect on the
+ * next frame */
+static gint audio_gain[2] = { MM_AUDIO_GAIN_UNITY, MM_AUDIO_GAIN_UNITY };
+static gint audio_mute[2];
+
+/* voice activity detection, atomic too: mean energy per sample
+ * (2^28 is full scale), sign changes per thousand samples, and
+ * microseconds of speech kept after the last voiced frame */
+static gint vad_enabled;
+static gint vad_energy = 8489;      /* -45 dBFS */
+static gint vad_crossings = 250;
+static gint vad_hangover = 200 * G_TIME_SPAN_MILLISECOND;
+
+/* atomic: microseconds of audio the recorder keeps for Opal, 0 to
+ * follow its buffers */
+static gint capture_depth;
+
+/* the bus watches of every backend run in this thread, away from
+ * the default main context of the application */
+static GMainContext *bus_context;
+static GThread *bus_thread;
+
+/* held while a bus message is handled, and while a watch is
+ * destroyed. It is not the backend's: a message waiting for it may
+ * belong to a backend finalized meanwhile. Recursive, as a handler of
+ * the signals may close a backend from the bus thread. */
+static GRecMutex bus_lock;
+
+enum {
+    SIGNAL_ERROR,
+    SIGNAL_MEDIA_READY,
+    SIGNAL_LAST
 };
 
+static guint signals[SIGNAL_LAST];
+
+/* The conference: its legs are backends without pipelines, whose
+ * audio is mixed in fixed blocks into the pipelines of a host
+ * backend. Each leg gets the capture plus the mix of the other legs.
+ * Guarded by conference_lock. */
+#define CONFERENCE_BLOCK (10 * G_TIME_SPAN_MILLISECOND)
+
+static GMutex conference_lock;
+static MmBackend *conference_host;
+static GList *conference_legs;
+static gint32 *conference_mix;   /* the sum of the legs, one block */
+static gint16 *conference_out;   /* a mix-minus, one block */
+static gsize conference_block;   /* bytes in a block */
+
+static gboolean conference_join (MmBackend *self, const char *dev,
+                                 MmBackendDirection dir, guint channels,
+                                 guint rate);
+static void conference_leave (MmBackend *self, MmBackendDirection dir);
+
+/* guarded by cache_lock, indexed by MmBackendDirection */
+static DeviceConfig device_config[2];
+static gint64 device_latency[2] = { -1, -1 };
+
 #define GET_PRIVATE(obj) \
 	(G_TYPE_INSTANCE_GET_PRIVATE((obj), MM_TYPE_BACKEND, MmBackendPrivate))
 
@@ -36,15 +281,49 @@ GST_DEBUG_CATEGORY(_debug);
 
 G_DEFINE_TYPE(MmBackend, mm_backend, G_TYPE_OBJECT)
 
+static inline gint64
+bytes_to_usecs (const AudioFormat *format, gsize bytes)
+{
+    if (format->rate == 0 || format->bpf == 0)
+        return 0;
+
+    return gst_util_uint64_scale (bytes, G_USEC_PER_SEC,
+                                  format->rate * format->bpf);
+}
+
+static void add_stats (MmBackendStats *total, const MmBackendStats *stats);
+
 static void
 finalize (GObject *object)
 {
     MmBackend *self = (MmBackend *) object;
+    MmBackendStats stats;
 
     mm_backend_audio_close (self);
 
-    gst_adapter_clear (self->priv->adapter_sink);
-    gst_object_unref (self->priv->adapter_sink);
+    /* keep its counters in the global ones */
+    mm_backend_get_stats (self, &stats);
+    g_mutex_lock (&stats_lock);
+    backends = g_list_remove (backends, self);
+    add_stats (&retired_stats, &stats);
+    g_mutex_unlock (&stats_lock);
+
+    mm_ring_free (self->priv->ring[MM_BACKEND_DIRECTION_PLAYER]);
+    mm_ring_free (self->priv->ring[MM_BACKEND_DIRECTION_RECORDER]);
+    if (self->priv->capture_pool) {
+        gst_buffer_pool_set_active (self->priv->capture_pool, FALSE);
+        gst_object_unref (self->priv->capture_pool);
+    }
+    mm_ring_free (self->priv->others);
+    g_free (self->priv->leg_block);
+    g_free (self->priv->others_block);
+
+    g_free (self->priv->device);
+
+    g_mutex_clear (&self->priv->lock);
+    g_cond_clear (&self->priv->cond);
+    g_mutex_clear (&self->priv->drop_lock);
+    g_mutex_clear (&self->priv->switch_lock);
 
     G_OBJECT_CLASS (mm_backend_parent_class)->finalize (object);
 }
@@ -56,6 +335,50 @@ mm_backend_class_init (MmBackendClass *klass)
     gobject_class->finalize = finalize;
 
     g_type_class_add_private (klass, sizeof (MmBackendPrivate));
+
+    /**
+     * MmBackend::error:
+     * @self: the #MmBackend
+     * @error: the error posted by the pipeline
+     *
+     * A pipeline of the backend failed. It is emitted from the bus
+     * thread of the backends, not from the main context of the
+     * application, so the handlers must be thread safe, and must not
+     * close the backend. Reads and writes go on, with silence, until
+     * the backend is closed.
+     */
+    signals[SIGNAL_ERROR] =
+        g_signal_new ("error", G_TYPE_FROM_CLASS (klass), G_SIGNAL_RUN_LAST,
+                      0, NULL, NULL, g_cclosure_marshal_VOID__BOXED,
+                      G_TYPE_NONE, 1, G_TYPE_ERROR);
+
+    /**
+     * MmBackend::media-ready:
+     * @self: the #MmBackend
+     * @direction: the #MmBackendDirection now running
+     * @latency: microseconds from the open to the PLAYING state
+     *
+     * The pipeline of @direction reached the PLAYING state, so audio
+     * now flows. Until then the player only keeps the playout target
+     * of what is written, and the recorder hands silence. It is
+     * emitted, once per direction and open, from the bus thread of the
+     * backends, like #MmBackend::error.
+     */
+    signals[SIGNAL_MEDIA_READY] =
+        g_signal_new ("media-ready", G_TYPE_FROM_CLASS (klass),
+                      G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL,
+                      G_TYPE_NONE, 2, G_TYPE_INT, G_TYPE_INT64);
+}
+
+static gpointer
+bus_thread_func (gpointer data)
+{
+    GMainLoop *loop = g_main_loop_new (bus_context, FALSE);
+
+    g_main_context_push_thread_default (bus_context);
+    g_main_loop_run (loop);
+
+    return NULL;
 }
 
 inline static void
@@ -68,6 +391,14 @@ check_gstreamer ()
         if (error)
             g_error ("GStreamer failure: %s", error->message);
     }
+
+    GST_DEBUG_CATEGORY_INIT (_debug, "mm", 0, "multimedia backend");
+
+    if (g_once_init_enter (&bus_thread)) {
+        bus_context = g_main_context_new ();
+        g_once_init_leave (&bus_thread,
+                           g_thread_new ("mm-bus", bus_thread_func, NULL));
+    }
 }
 
 static void
@@ -75,14 +406,21 @@ mm_backend_init (MmBackend *self)
 {
     check_gstreamer ();
 
-    GST_DEBUG_CATEGORY_INIT (_debug, "mm", 0, "multimedia backend");
     self->priv = GET_PRIVATE (self);
 
-    self->priv->adapter_sink = gst_adapter_new ();
+    g_mutex_init (&self->priv->lock);
+    g_cond_init (&self->priv->cond);
+    g_mutex_init (&self->priv->drop_lock);
+    g_mutex_init (&self->priv->switch_lock);
+    self->priv->playout_target = PLAYOUT_TARGET;
+
+    g_mutex_lock (&stats_lock);
+    backends = g_list_prepend (backends, self);
+    g_mutex_unlock (&stats_lock);
 }
 
 static void
-handle_error (GstMessage *msg)
+handle_error (MmBackend *self, GstMessage *msg)
 {
   gchar *debug = NULL;
   GError *err = NULL;
@@ -92,20 +430,115 @@ handle_error (GstMessage *msg)
   g_free (debug);
 
   g_printerr ("Error: %s\n", err->message);
+
+  /* a broken pipeline must not go back to the cache */
+  if (self->priv->player &&
+      gst_object_has_as_ancestor (msg->src, (GstObject *) self->priv->player))
+      g_atomic_int_set (&self->priv->failed[MM_BACKEND_DIRECTION_PLAYER], TRUE);
+  if (self->priv->recorder &&
+      gst_object_has_as_ancestor (msg->src, (GstObject *) self->priv->recorder))
+      g_atomic_int_set (&self->priv->failed[MM_BACKEND_DIRECTION_RECORDER], TRUE);
+  g_signal_emit (self, signals[SIGNAL_ERROR], 0, err);
+
   g_error_free (err);
 }
 
-static gboolean
-bus_cb (GstBus *bus, GstMessage *msg, gpointer data)
+inline static GstElement *
+get_element (GstElement *bin, const char *name)
+{
+    if (bin)
+        return gst_bin_get_by_name (GST_BIN (bin), name);
+
+    return NULL;
+}
+
+static gint64
+query_latency (GstElement *pipe, const gchar *name)
+{
+    GstElement *element;
+    GstQuery *query;
+    GstClockTime min = GST_CLOCK_TIME_NONE;
+    gboolean live;
+
+    element = get_element (pipe, name);
+    if (!element)
+        return 0;
+
+    /* audio sinks add their ring buffer latency to the upstream one */
+    query = gst_query_new_latency ();
+    if (gst_element_query (element, query))
+        gst_query_parse_latency (query, &live, &min, NULL);
+    gst_query_unref (query);
+    gst_object_unref (element);
+
+    return GST_CLOCK_TIME_IS_VALID (min) ? (gint64) GST_TIME_AS_USECONDS (min) : 0;
+}
+
+static void
+measure_device_latency (MmBackend *self, GstElement *pipe)
+{
+    MmBackendPrivate *priv = self->priv;
+    gint64 player = 0, recorder = 0;
+
+    if (pipe == priv->player)
+        player = query_latency (pipe, "audio-sink");
+    if (pipe == priv->recorder)
+        recorder = query_latency (pipe, "audio-src");
+
+    g_mutex_lock (&priv->lock);
+    if (pipe == priv->player)
+        priv->stats.player_device_latency = player;
+    if (pipe == priv->recorder)
+        priv->stats.recorder_device_latency = recorder;
+    player = priv->stats.player_device_latency;
+    recorder = priv->stats.recorder_device_latency;
+    g_mutex_unlock (&priv->lock);
+
+    /* the synthetic devices say nothing about the sound card */
+    if (!priv->device) {
+        g_mutex_lock (&cache_lock);
+        if (pipe == priv->player)
+            device_latency[MM_BACKEND_DIRECTION_PLAYER] = player;
+        if (pipe == priv->recorder)
+            device_latency[MM_BACKEND_DIRECTION_RECORDER] = recorder;
+        g_mutex_unlock (&cache_lock);
+    }
+
+    GST_INFO ("device latency: player %" G_GINT64_FORMAT " us, "
+              "recorder %" G_GINT64_FORMAT " us", player, recorder);
+}
+
+/* the pipeline of @dir went PLAYING */
+static void
+set_ready (MmBackend *self, MmBackendDirection dir)
 {
-    MmBackend *self = data;
+    MmBackendPrivate *priv = self->priv;
+    gint64 latency;
+
+    if (!g_atomic_int_compare_and_exchange (&priv->ready[dir], FALSE, TRUE))
+        return;
 
+    latency = g_get_monotonic_time () - priv->started_at[dir];
+    g_mutex_lock (&priv->lock);
+    if (dir == MM_BACKEND_DIRECTION_PLAYER)
+        priv->stats.player_ready_latency = latency;
+    else
+        priv->stats.recorder_ready_latency = latency;
+    g_mutex_unlock (&priv->lock);
+
+    GST_INFO ("direction %d ready in %" G_GINT64_FORMAT " us", dir, latency);
+    g_signal_emit (self, signals[SIGNAL_MEDIA_READY], 0, dir, latency);
+}
+
+static gboolean
+handle_bus_message (MmBackend *self, GstMessage *msg)
+{
     switch (GST_MESSAGE_TYPE (msg)) {
     case GST_MESSAGE_EOS:
         g_print ("End-of-stream\n");
         break;
     case GST_MESSAGE_ERROR:
-        handle_error (msg);
+        handle_error (self, msg);
         break;
     case GST_MESSAGE_STATE_CHANGED:
     {
@@ -118,7 +551,41 @@ bus_cb (GstBus *bus, GstMessage *msg, gpointer data)
                        GST_OBJECT_NAME (msg->src),
                        gst_element_state_get_name (old),
                        gst_element_state_get_name (new));
+
+            /* the devices are negotiated by now */
+            if (new == GST_STATE_PLAYING) {
+                measure_device_latency (self, (GstElement *) msg->src);
+                if (msg->src == (GstObject *) self->priv->player)
+                    set_ready (self, MM_BACKEND_DIRECTION_PLAYER);
+                if (msg->src == (GstObject *) self->priv->recorder)
+                    set_ready (self, MM_BACKEND_DIRECTION_RECORDER);
+            }
+        }
+        break;
+    }
+    case GST_MESSAGE_CLOCK_LOST:
+    {
+        GstElement *pipe = (GstElement *) GST_MESSAGE_SRC (msg);
+
+        /* the device switched out provided the clock: going through
+         * PAUSED makes the pipeline pick another one */
+        if ((pipe == self->priv->player || pipe == self->priv->recorder) &&
+            !g_atomic_int_get (&self->priv->held)) {
+            GST_INFO ("clock lost, selecting a new one");
+            gst_element_set_state (pipe, GST_STATE_PAUSED);
+            gst_element_set_state (pipe, GST_STATE_PLAYING);
+        }
+        break;
+    }
+    case GST_MESSAGE_LATENCY:
+    {
+        GstElement *pipe = (GstElement *) GST_MESSAGE_SRC (msg);
+
+        if (pipe == self->priv->player || pipe == self->priv->recorder) {
+            gst_bin_recalculate_latency (GST_BIN (pipe));
+            measure_device_latency (self, pipe);
         }
+        break;
     }
     default:
         break;
@@ -127,267 +594,3537 @@ bus_cb (GstBus *bus, GstMessage *msg, gpointer data)
     return TRUE;
 }
 
-static const gchar *
-get_player_desc ()
+/* runs in the bus thread. Once the watch is destroyed, under the bus
+ * lock, the backend may be already gone: @data is not touched before
+ * that is checked. */
+static gboolean
+bus_cb (GstBus *bus, GstMessage *msg, gpointer data)
 {
-    return "appsrc is-live=true format=time do-timestamp=true name=opal-src "
-        "! autoaudiosink name=audio-sink ";
-}
+    gboolean ret = FALSE;
 
-static const gchar *
-get_recorder_desc ()
-{
-    return "autoaudiosrc name=audio-src "
-        "! appsink name=opal-sink max_buffers=2 drop=true";
+    g_rec_mutex_lock (&bus_lock);
+    if (!g_source_is_destroyed (g_main_current_source ()))
+        ret = handle_bus_message (data, msg);
+    g_rec_mutex_unlock (&bus_lock);
+
+    return ret;
 }
 
-inline static GstElement *
-get_element (GstElement *bin, const char *name)
+static GSource *
+add_bus_watch (MmBackend *self, GstElement *pipe)
 {
-    if (bin)
-        return gst_bin_get_by_name (GST_BIN (bin), name);
+    GstBus *bus = gst_element_get_bus (pipe);
+    GSource *source = gst_bus_create_watch (bus);
 
-    return NULL;
+    g_source_set_callback (source, (GSourceFunc) bus_cb, self, NULL);
+    g_source_attach (source, bus_context);
+    gst_object_unref (bus);
+
+    return source;
 }
 
 static void
-set_audio_config (GstChildProxy *proxy,
-                  GObject *object,
-                  gchar *name,
-                  gpointer user_data)
+remove_bus_watch (GSource *source)
 {
-    GParamSpec *spec;
+    /* a message being handled finishes first */
+    g_rec_mutex_lock (&bus_lock);
+    g_source_destroy (source);
+    g_rec_mutex_unlock (&bus_lock);
 
-    spec = g_object_class_find_property (G_OBJECT_GET_CLASS (object),
-                                         "stream-properties");
-    if (spec) {
-        GstStructure *props;
-
-        props = gst_structure_new ("props",
-                                   "media.role", G_TYPE_STRING, "phone",
-                                   "filter.want", G_TYPE_STRING, "echo-cancel",
-                                   NULL);
-        g_object_set (object, "stream-properties", props, NULL);
-
-        gst_structure_free (props);
-    }
+    g_source_unref (source);
 }
 
-gboolean
-mm_backend_audio_open (MmBackend *self,
-                       const char *dev,
-                       MmBackendDirection dir,
-                       guint channels,
-                       guint rate)
+static gboolean
+have_echo_canceller (void)
 {
-    GST_INFO ("opening device %s / direction = %d", dev, dir);
-
-    GstBus *bus;
-    GError *error = NULL;
-    GstStateChangeReturn ret;
-    const gchar *desc, *name;
-    GstElement *pipe, *app, *audio;
-
-    if ((dir == MM_BACKEND_DIRECTION_PLAYER && self->priv->player) ||
-        (dir == MM_BACKEND_DIRECTION_RECORDER && self->priv->recorder)) {
-        GST_INFO("player / recorder already exists");
-        return TRUE;
-    }
+    GstElementFactory *factory;
 
-    if (dir == MM_BACKEND_DIRECTION_PLAYER) {
-        name = "audio-player";
-        desc = get_player_desc ();
-    } else if (dir == MM_BACKEND_DIRECTION_RECORDER) {
-        name = "audio-recorder";
-        desc = get_recorder_desc ();
-    } else {
+    factory = gst_element_factory_find ("webrtcdsp");
+    if (!factory) {
+        GST_WARNING ("no webrtcdsp: duplex without echo cancellation");
         return FALSE;
     }
 
-    pipe = gst_parse_launch (desc, &error);
-    if (error) {
-        GST_ERROR ("Pipeline parsing error: %s\n", error->message);
-        g_error_free (error);
-        return FALSE;
-    }
+    gst_object_unref (factory);
+    return TRUE;
+}
 
-    gst_element_set_name (pipe, name);
+static void
+underrun_cb (GstElement *queue, gpointer user_data)
+{
+    MmBackend *self = user_data;
 
-    if (dir == MM_BACKEND_DIRECTION_PLAYER) {
-        app = get_element (pipe, "opal-src");
-        if (!app)
-            return FALSE;
+    /* the player queue ran dry */
+    g_atomic_int_inc (&self->priv->write_underruns);
+}
 
-        audio = get_element (pipe, "audio-sink");
-        if (!audio) {
-            gst_object_unref (app);
-            return FALSE;
-        }
+static void
+overrun_cb (GstElement *queue, gpointer user_data)
+{
+    MmBackend *self = user_data;
 
-        self->priv->player = pipe;
-        self->priv->appsrc = (GstAppSrc *) app;
-    } else {
-        app = get_element (pipe, "opal-sink");
-        if (!app)
-            return FALSE;
+    /* the queue is about to drop its oldest data */
+    g_atomic_int_inc (&self->priv->write_dropped);
+}
 
-        audio = get_element (pipe, "audio-src");
-        if (!audio) {
-            gst_object_unref (app);
-            return FALSE;
+static void
+apply_buffers (MmBackend *self, MmBackendDirection dir)
+{
+    MmBackendPrivate *priv = self->priv;
+    BufferConfig *config = &priv->buffers[dir];
+    gint64 max_latency;
+
+    /* appsrc only ever holds the frame being pumped, and the reader
+     * bounds the capture ring, so the queue is the only one to tune */
+    if (dir == MM_BACKEND_DIRECTION_PLAYER && priv->player) {
+        max_latency = priv->max_latency;
+        if (max_latency == 0 && config->count > 0) {
+            max_latency = bytes_to_usecs (&priv->format[dir],
+                                          config->size * config->count);
         }
+        if (max_latency == 0)
+            max_latency = PLAYOUT_MAX_LATENCY;
 
-        self->priv->recorder = pipe;
-        self->priv->appsink = (GstAppSink *) app;
+        GST_INFO ("playout latency ceiling: %" G_GINT64_FORMAT " us",
+                  max_latency);
+        g_object_set (priv->queue,
+                      "max-size-time", (guint64) max_latency * GST_USECOND,
+                      NULL);
     }
+}
 
-    {
-        GstCaps *caps;
+static void
+set_stream_properties (GstElement *element, gboolean canceller)
+{
+    GstStructure *props;
 
-        caps = gst_caps_new_simple ("audio/x-raw",
-                                    "layout", G_TYPE_STRING, "interleaved",
-                                    "format", G_TYPE_STRING, "S16LE",
-                                    "rate", G_TYPE_INT, rate,
-                                    "channels", G_TYPE_INT, channels,
-                                    NULL);
-        g_object_set (app, "caps", caps, NULL);
-        gst_caps_unref (caps);
+    props = gst_structure_new ("props",
+                               "media.role", G_TYPE_STRING, "phone",
+                               NULL);
+
+    /* ask the sound server to cancel the echo, unless we do it */
+    if (!canceller) {
+        gst_structure_set (props,
+                           "filter.want", G_TYPE_STRING, "echo-cancel",
+                           NULL);
     }
 
-    g_signal_connect (audio, "child-added", G_CALLBACK (set_audio_config), self);
+    g_object_set (element, "stream-properties", props, NULL);
+
+    gst_structure_free (props);
+}
 
-    bus = gst_element_get_bus (pipe);
-    gst_bus_add_watch (bus, bus_cb, self);
-    g_object_unref (bus);
+/* configures the audio devices as they get into the pipeline, even
+ * the ones autoaudiosink / autoaudiosrc create when they go READY */
+static void
+configure_element (GstBin *bin,
+                   GstBin *sub_bin,
+                   GstElement *element,
+                   gpointer user_data)
+{
+    gboolean canceller = GPOINTER_TO_INT (user_data);
+    GObjectClass *klass = G_OBJECT_GET_CLASS (element);
+    DeviceConfig *config;
+    gint64 latency_time, buffer_time;
 
-    ret = gst_element_set_state (pipe, GST_STATE_PLAYING);
+    if (g_object_class_find_property (klass, "stream-properties"))
+        set_stream_properties (element, canceller);
 
-    GST_INFO ("change state is %s",
-              gst_element_state_change_return_get_name(ret));
+    if (GST_OBJECT_FLAG_IS_SET (element, GST_ELEMENT_FLAG_SINK))
+        config = &device_config[MM_BACKEND_DIRECTION_PLAYER];
+    else if (GST_OBJECT_FLAG_IS_SET (element, GST_ELEMENT_FLAG_SOURCE))
+        config = &device_config[MM_BACKEND_DIRECTION_RECORDER];
+    else
+        return;
 
-    return (ret == GST_STATE_CHANGE_SUCCESS || ret == GST_STATE_CHANGE_ASYNC);
+    g_mutex_lock (&cache_lock);
+    latency_time = config->latency_time;
+    buffer_time = config->buffer_time;
+    g_mutex_unlock (&cache_lock);
+
+    if (latency_time > 0 && g_object_class_find_property (klass, "latency-time"))
+        g_object_set (element, "latency-time", latency_time, NULL);
+
+    if (buffer_time > 0 && g_object_class_find_property (klass, "buffer-time"))
+        g_object_set (element, "buffer-time", buffer_time, NULL);
 }
 
-gboolean
-mm_backend_audio_is_open (MmBackend *self)
+static GstElement *
+add_element (GstElement *bin, const gchar *factory, const gchar *name)
 {
-    return self->priv->player || self->priv->recorder;
+    GstElement *element;
+
+    element = gst_element_factory_make (factory, name);
+    if (!element) {
+        GST_ERROR ("cannot create a %s element", factory);
+        return NULL;
+    }
+
+    gst_bin_add (GST_BIN (bin), element);
+
+    return element;
 }
 
-MmBackend *
-mm_backend_new (void)
+static GstElement *
+add_bin (GstElement *bin, const gchar *desc, const gchar *name)
 {
-    return g_object_new (MM_TYPE_BACKEND, NULL);
+    GstElement *element;
+    GError *error = NULL;
+
+    element = gst_parse_bin_from_description (desc, TRUE, &error);
+    if (error) {
+        GST_ERROR ("cannot parse %s: %s", desc, error->message);
+        g_error_free (error);
+        if (element)
+            gst_object_unref (element);
+        return NULL;
+    }
+
+    gst_element_set_name (element, name);
+    gst_bin_add (GST_BIN (bin), element);
+
+    return element;
 }
 
-static gboolean
-shutdown_pipeline (GstElement *pipe, GstElement *app)
+/* "Gst:test" generates a tone and discards the playback, and
+ * "Gst:wav=<file>" reads the capture from, or writes the playback
+ * to, a WAV file; both run on the pipeline clock as a real device */
+static GstElement *
+add_synthetic_element (GstElement *bin,
+                       MmBackendDirection dir,
+                       const gchar *name,
+                       const gchar *device)
 {
-    GstStateChangeReturn ret;
+    GstElement *element, *file;
 
-    gst_object_unref (app);
-    ret = gst_element_set_state (pipe, GST_STATE_NULL);
-    gst_object_unref (pipe);
+    if (g_str_has_prefix (device, DEVICE_WAV)) {
+        element = add_bin (bin, synthetic_devices[1][dir], name);
+        if (!element)
+            return NULL;
+
+        file = get_element (element, "file");
+        g_object_set (file, "location", device + strlen (DEVICE_WAV), NULL);
+        gst_object_unref (file);
 
-    return ret == GST_STATE_CHANGE_SUCCESS || ret == GST_STATE_CHANGE_ASYNC;
+        return element;
+    }
+
+    return add_bin (bin, synthetic_devices[0][dir], name);
 }
 
-gboolean
-mm_backend_audio_close (MmBackend *self)
+/* the element of a device seen by the monitor, or NULL if it is not
+ * there anymore */
+static GstElement *
+add_named_element (GstElement *bin,
+                   MmBackendDirection dir,
+                   const gchar *name,
+                   const gchar *device)
 {
-    GST_INFO ("closing audio devices");
+    GstDevice *object = NULL;
+    GstElement *element;
+    guint i;
 
-    if (self->priv->player) {
-        shutdown_pipeline (self->priv->player,
-                           (GstElement *) self->priv->appsrc);
-        self->priv->player = NULL;
-        self->priv->appsrc = NULL;
+    g_mutex_lock (&devices_lock);
+    for (i = 0; device_names[dir] && i < device_names[dir]->len; i++) {
+        if (g_str_equal (g_ptr_array_index (device_names[dir], i), device)) {
+            object = gst_object_ref (g_ptr_array_index (device_objects[dir], i));
+            break;
+        }
     }
+    g_mutex_unlock (&devices_lock);
 
-    if (self->priv->recorder) {
-        shutdown_pipeline (self->priv->recorder,
-                           (GstElement *) self->priv->appsink);
-        self->priv->recorder = NULL;
-        self->priv->appsink = NULL;
-    }
+    if (!object)
+        return NULL;
 
-    return TRUE;
+    element = gst_device_create_element (object, name);
+    gst_object_unref (object);
+    if (!element)
+        return NULL;
+
+    gst_bin_add (GST_BIN (bin), element);
+
+    return element;
 }
 
-void
-mm_backend_set_buffer_size (MmBackend *self,
-                            MmBackendDirection dir,
-                            size_t size)
+/* the device element is either autoaudiosink / autoaudiosrc, the
+ * pipeline fragment set with mm_backend_set_audio_element(), a device
+ * seen by the monitor or a synthetic device */
+static GstElement *
+add_audio_element (GstElement *bin,
+                   MmBackendDirection dir,
+                   const gchar *name,
+                   const gchar *device)
 {
-    g_return_if_fail (MM_IS_BACKEND (self));
+    GstElement *element;
+    gchar *desc;
 
-    GstElement *el;
+    if (device && g_str_has_prefix (device, DEVICE_NAMED)) {
+        element = add_named_element (bin, dir, name,
+                                     device + strlen (DEVICE_NAMED));
+        if (element)
+            return element;
 
-    if (dir == MM_BACKEND_DIRECTION_PLAYER)
-        el = (GstElement *) self->priv->appsrc;
-    else if (dir == MM_BACKEND_DIRECTION_RECORDER)
-        el = (GstElement *) self->priv->appsink;
-    else
-        return;
+        /* unplugged, or the other direction of a duplex pipeline */
+        GST_INFO ("no %s device for direction %d, using the default",
+                  device, dir);
+        device = NULL;
+    }
 
-    g_object_set (el, "blocksize", size, NULL);
+    if (device)
+        return add_synthetic_element (bin, dir, name, device);
+
+    g_mutex_lock (&cache_lock);
+    desc = g_strdup (device_config[dir].description);
+    g_mutex_unlock (&cache_lock);
+
+    if (!desc) {
+        return add_element (bin, dir == MM_BACKEND_DIRECTION_PLAYER ?
+                            "autoaudiosink" : "autoaudiosrc", name);
+    }
+
+    element = add_bin (bin, desc, name);
+    g_free (desc);
+
+    return element;
 }
 
-gboolean
-mm_backend_audio_write (MmBackend *self,
-                        const void *buf,
-                        size_t len,
-                        size_t *written)
+/* appsrc ! queue [! webrtcechoprobe] ! autoaudiosink */
+static gboolean
+build_player_branch (GstElement *pipe, gboolean canceller, const gchar *device)
 {
-    g_return_val_if_fail (MM_IS_BACKEND (self), FALSE);
+    GstElement *src, *queue, *probe = NULL, *sink;
 
-    GstBuffer *buffer;
-    {
-        GstMapInfo map;
-        buffer = gst_buffer_new_and_alloc (len);
+    src = add_element (pipe, "appsrc", "opal-src");
+    queue = add_element (pipe, "queue", "playout-queue");
+    if (canceller)
+        probe = add_element (pipe, "webrtcechoprobe", "echo-probe");
+    sink = add_audio_element (pipe, MM_BACKEND_DIRECTION_PLAYER, "audio-sink",
+                              device);
 
-        if (!gst_buffer_map (buffer, &map, GST_MAP_WRITE)) {
-            gst_buffer_unref (buffer);
-            return FALSE;
-        }
+    if (!src || !queue || (canceller && !probe) || !sink)
+        return FALSE;
 
-        memcpy (map.data, buf, len);
-        gst_buffer_unmap (buffer, &map);
-    }
+    g_object_set (src,
+                  "is-live", TRUE,
+                  "format", GST_FORMAT_TIME,
+                  "do-timestamp", TRUE,
+                  NULL);
 
-    GST_DEBUG ("write %ld", len);
-    GST_MEMDUMP ("write: ", buf, len);
-    GstFlowReturn ret = gst_app_src_push_buffer (self->priv->appsrc, buffer);
+    gst_util_set_object_arg (G_OBJECT (queue), "leaky", "downstream");
+    g_object_set (queue,
+                  "max-size-buffers", 0,
+                  "max-size-bytes", 0,
+                  NULL);
 
-    *written = len;
+    if (probe)
+        return gst_element_link_many (src, queue, probe, sink, NULL);
 
-    return ret == GST_FLOW_OK;
+    return gst_element_link_many (src, queue, sink, NULL);
 }
 
-gboolean
-mm_backend_audio_read (MmBackend *self,
-                       void *buf,
-                       size_t len,
-                       size_t *read)
+/* autoaudiosrc [! webrtcdsp] ! appsink */
+static gboolean
+build_recorder_branch (GstElement *pipe, gboolean canceller, const gchar *device)
 {
-    g_return_val_if_fail (MM_IS_BACKEND (self), FALSE);
+    GstElement *src, *dsp = NULL, *sink;
 
-    GST_DEBUG ("to read %ld", len);
-    GstSample *sample = gst_app_sink_pull_sample (self->priv->appsink);
-    if (sample) {
-        GstBuffer *buffer = gst_buffer_copy (gst_sample_get_buffer (sample));
-        gst_adapter_push (self->priv->adapter_sink, buffer);
-        gst_sample_unref (sample);
-    }
+    src = add_audio_element (pipe, MM_BACKEND_DIRECTION_RECORDER, "audio-src",
+                             device);
+    if (canceller)
+        dsp = add_element (pipe, "webrtcdsp", "echo-canceller");
+    sink = add_element (pipe, "appsink", "opal-sink");
 
-    *read = MIN (len, gst_adapter_available (self->priv->adapter_sink));
-    GST_DEBUG ("read %ld", *read);
+    if (!src || (canceller && !dsp) || !sink)
+        return FALSE;
 
-    if (*read > 0) {
-        gst_adapter_copy (self->priv->adapter_sink, buf, 0, *read);
-        gst_adapter_flush (self->priv->adapter_sink, *read);
-        GST_MEMDUMP ("read: ", buf, *read);
+    /* the new-sample callback takes every buffer at once, so appsink
+     * never has to queue, nor silently drop, any: the recorder does
+     * the dropping, and counts it */
+    g_object_set (sink,
+                  "max-buffers", 0,
+                  "drop", FALSE,
+                  NULL);
+
+    if (dsp) {
+        /* the canceller takes the far end signal from the probe */
+        g_object_set (dsp, "probe", "echo-probe", NULL);
+        return gst_element_link_many (src, dsp, sink, NULL);
+    }
+
+    return gst_element_link (src, sink);
+}
+
+/* Schedules the calling thread as the policy says. The threads are
+ * reused, so without a policy they are given back the scheduling,
+ * niceness and CPUs of the process. It only logs what it is not
+ * allowed to do: the audio flows anyway. */
+static void
+make_thread_realtime (const gchar *name)
+{
+    MmBackendRealtime policy;
+    struct sched_param param = { 0, };
+    cpu_set_t cpus;
+    gboolean pinned;
+    gint generation, priority, niceness, sched = SCHED_OTHER, err;
+
+    g_mutex_lock (&realtime_lock);
+    generation = realtime_generation;
+    policy = realtime_policy;
+    priority = realtime_priority;
+    pinned = realtime_pinned;
+    cpus = realtime_cpus;
+    g_mutex_unlock (&realtime_lock);
+
+    /* never configured: the threads are left as they are */
+    if (generation == 0)
+        return;
+
+    niceness = getpriority (PRIO_PROCESS, getpid ());
+    switch (policy) {
+    case MM_BACKEND_REALTIME_NICE:
+        niceness = priority;
+        break;
+    case MM_BACKEND_REALTIME_RR:
+        sched = SCHED_RR;
+        param.sched_priority = priority;
+        break;
+    case MM_BACKEND_REALTIME_FIFO:
+        sched = SCHED_FIFO;
+        param.sched_priority = priority;
+        break;
+    default:
+        break;
+    }
+
+    err = pthread_setschedparam (pthread_self (), sched, &param);
+    if (err && sched != SCHED_OTHER) {
+        GST_WARNING ("%s: no real-time priority: %s", name, g_strerror (err));
+        niceness = REALTIME_NICE;
+    } else if (err) {
+        GST_WARNING ("%s: not back to SCHED_OTHER: %s", name, g_strerror (err));
+    } else if (sched != SCHED_OTHER) {
+        GST_INFO ("%s: real-time priority %d", name, priority);
+    }
+
+    if (setpriority (PRIO_PROCESS, syscall (SYS_gettid), niceness) == 0)
+        GST_INFO ("%s: niceness %d", name, niceness);
+    else
+        GST_WARNING ("%s: no niceness %d: %s", name, niceness,
+                     g_strerror (errno));
+
+    if (!pinned && sched_getaffinity (getpid (), sizeof (cpus), &cpus) != 0)
+        return;
+
+    err = pthread_setaffinity_np (pthread_self (), sizeof (cpus), &cpus);
+    if (err)
+        GST_WARNING ("%s: not pinned: %s", name, g_strerror (err));
+}
+
+/* runs in the thread posting the message: ENTER comes from each
+ * streaming thread as it starts */
+static GstBusSyncReply
+stream_status_cb (GstBus *bus, GstMessage *msg, gpointer data)
+{
+    GstStreamStatusType type;
+    GstElement *owner;
+
+    if (GST_MESSAGE_TYPE (msg) != GST_MESSAGE_STREAM_STATUS)
+        return GST_BUS_PASS;
+
+    gst_message_parse_stream_status (msg, &type, &owner);
+    if (type == GST_STREAM_STATUS_TYPE_ENTER)
+        make_thread_realtime (GST_OBJECT_NAME (owner));
+
+    return GST_BUS_PASS;
+}
+
+/* the Opal threads are scheduled on their first frame after each
+ * change of the settings */
+static inline void
+make_io_thread_realtime (void)
+{
+    gint generation = g_atomic_int_get (&realtime_generation);
+
+    if (G_LIKELY (GPOINTER_TO_INT (g_private_get (&realtime_thread)) ==
+                  generation))
+        return;
+
+    g_private_set (&realtime_thread, GINT_TO_POINTER (generation));
+    make_thread_realtime ("opal");
+}
+
+static GstElement *
+build_pipeline (PipelineKind kind, const gchar *device)
+{
+    static const gchar *names[] = {
+        "audio-player", "audio-recorder", "audio-duplex"
+    };
+    GstElement *pipe;
+    GstBus *bus;
+    gboolean canceller, ret = TRUE;
+
+    canceller = (kind == PIPELINE_DUPLEX) && have_echo_canceller ();
+
+    pipe = gst_pipeline_new (names[kind]);
+    gst_object_ref_sink (pipe);
+
+    g_signal_connect (pipe, "deep-element-added",
+                      G_CALLBACK (configure_element),
+                      GINT_TO_POINTER (canceller));
+
+    bus = gst_pipeline_get_bus (GST_PIPELINE (pipe));
+    gst_bus_set_sync_handler (bus, stream_status_cb, NULL, NULL);
+    gst_object_unref (bus);
+
+    if (kind != PIPELINE_RECORDER)
+        ret = build_player_branch (pipe, canceller, device);
+    if (ret && kind != PIPELINE_PLAYER)
+        ret = build_recorder_branch (pipe, canceller, device);
+
+    if (!ret) {
+        GST_ERROR ("cannot build the %s pipeline", names[kind]);
+        gst_object_unref (pipe);
+        return NULL;
+    }
+
+    return pipe;
+}
+
+static GstElement *
+cache_take (PipelineKind kind)
+{
+    GstElement *pipe;
+
+    g_mutex_lock (&cache_lock);
+    pipe = g_queue_pop_head (&pipeline_cache[kind]);
+    g_mutex_unlock (&cache_lock);
+
+    return pipe;
+}
+
+/* the state of the pipelines kept between calls */
+static GstState
+idle_state (void)
+{
+    switch (g_atomic_int_get (&idle_policy)) {
+    case MM_BACKEND_IDLE_TEARDOWN:
+        return GST_STATE_NULL;
+    case MM_BACKEND_IDLE_READY:
+        return GST_STATE_READY;
+    default:
+        return GST_STATE_PAUSED;
+    }
+}
+
+/* takes the ownership of @pipe, and keeps it in @state */
+static void
+cache_give (PipelineKind kind, GstElement *pipe, GstState state)
+{
+    gboolean cached = FALSE;
+
+    if (state == GST_STATE_NULL) {
+        gst_element_set_state (pipe, GST_STATE_NULL);
+        gst_object_unref (pipe);
+        return;
+    }
+
+    /* READY flushes whatever the last call left in the pipeline, and
+     * closes the devices; PAUSED opens them again for the next one */
+    gst_element_set_state (pipe, GST_STATE_READY);
+    if (state == GST_STATE_PAUSED)
+        gst_element_set_state (pipe, GST_STATE_PAUSED);
+
+    g_mutex_lock (&cache_lock);
+    if (g_queue_get_length (&pipeline_cache[kind]) < CACHE_SIZE) {
+        g_queue_push_tail (&pipeline_cache[kind], pipe);
+        cached = TRUE;
+    }
+    g_mutex_unlock (&cache_lock);
+
+    if (!cached) {
+        gst_element_set_state (pipe, GST_STATE_NULL);
+        gst_object_unref (pipe);
+    }
+}
+
+static gpointer
+prewarm_thread (gpointer data)
+{
+    PipelineKind kind = GPOINTER_TO_INT (data);
+    GstElement *pipe;
+
+    /* a call is coming: it is built, even if not kept between calls */
+    pipe = build_pipeline (kind, NULL);
+    if (pipe)
+        cache_give (kind, pipe, MAX (idle_state (), GST_STATE_READY));
+
+    return NULL;
+}
+
+static void
+prewarm (PipelineKind kind)
+{
+    gboolean empty;
+
+    g_mutex_lock (&cache_lock);
+    empty = g_queue_is_empty (&pipeline_cache[kind]);
+    g_mutex_unlock (&cache_lock);
+
+    if (empty) {
+        g_thread_unref (g_thread_new ("mm-prewarm", prewarm_thread,
+                                      GINT_TO_POINTER (kind)));
+    }
+}
+
+/* A streaming thread is due a buffer of @duration microseconds after
+ * the previous one. One coming more than a whole buffer late missed its
+ * deadline, unless it was @starved of audio. */
+static void
+check_deadline (MmBackend *self, MmBackendDirection dir, gint64 duration,
+                gboolean starved)
+{
+    MmBackendPrivate *priv = self->priv;
+    gint64 now = g_get_monotonic_time ();
+    gint64 last = priv->last_buffer[dir];
+
+    priv->last_buffer[dir] = now;
+
+    if (last && duration > 0 && now - last > 2 * duration && !starved)
+        g_atomic_int_inc (&priv->deadline_misses);
+}
+
+/* a pause of the data flow is no miss */
+static inline void
+reset_deadline (MmBackend *self, MmBackendDirection dir)
+{
+    self->priv->last_buffer[dir] = 0;
+}
+
+/* the direction opens at @now: its start latency runs until the
+ * first buffer */
+static void
+set_opened (MmBackend *self, MmBackendDirection dir, gint64 now)
+{
+    MmBackendPrivate *priv = self->priv;
+
+    g_mutex_lock (&priv->lock);
+    priv->opened_at[dir] = now;
+    g_mutex_unlock (&priv->lock);
+
+    priv->started_at[dir] = now;
+    g_atomic_int_set (&priv->starting[dir], TRUE);
+}
+
+/* the first buffer of @dir reached the sink, or left the source */
+static void
+set_started (MmBackend *self, MmBackendDirection dir)
+{
+    MmBackendPrivate *priv = self->priv;
+    gint64 latency;
+
+    g_mutex_lock (&priv->lock);
+    latency = g_get_monotonic_time () - priv->opened_at[dir];
+    if (dir == MM_BACKEND_DIRECTION_PLAYER)
+        priv->stats.player_start_latency = latency;
+    else
+        priv->stats.recorder_start_latency = latency;
+    g_mutex_unlock (&priv->lock);
+
+    GST_INFO ("direction %d started after %" G_GINT64_FORMAT " us",
+              dir, latency);
+}
+
+static GstPadProbeReturn
+render_probe_cb (GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    MmBackend *self = user_data;
+    MmBackendPrivate *priv = self->priv;
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+    GstElement *sink;
+    GstClock *clock;
+    GstClockTime now, pts = GST_BUFFER_PTS (buffer);
+    gint latency, max;
+    guint bucket;
+
+    /* what is still to render is the level of the player */
+    if (GST_BUFFER_OFFSET_END_IS_VALID (buffer))
+        g_atomic_int_set (&priv->rendered, (gint) GST_BUFFER_OFFSET_END (buffer));
+
+    /* a late buffer with more written behind it was the thread's fault */
+    check_deadline (self, MM_BACKEND_DIRECTION_PLAYER,
+                    GST_BUFFER_DURATION_IS_VALID (buffer) ?
+                    (gint64) GST_TIME_AS_USECONDS (GST_BUFFER_DURATION (buffer)) :
+                    bytes_to_usecs (&priv->format[MM_BACKEND_DIRECTION_PLAYER],
+                                    gst_buffer_get_size (buffer)),
+                    g_atomic_int_get (&priv->written_low) ==
+                    g_atomic_int_get (&priv->rendered));
+
+    if (g_atomic_int_compare_and_exchange (&priv->starting[MM_BACKEND_DIRECTION_PLAYER],
+                                           TRUE, FALSE))
+        set_started (self, MM_BACKEND_DIRECTION_PLAYER);
+
+    sink = gst_pad_get_parent_element (pad);
+    clock = sink ? gst_element_get_clock (sink) : NULL;
+    if (!clock || !GST_CLOCK_TIME_IS_VALID (pts)) {
+        if (clock)
+            gst_object_unref (clock);
+        if (sink)
+            gst_object_unref (sink);
+        return GST_PAD_PROBE_OK;
+    }
+
+    /* appsrc stamps each buffer with the running time of its write */
+    now = gst_clock_get_time (clock) - gst_element_get_base_time (sink);
+    gst_object_unref (clock);
+    gst_object_unref (sink);
+
+    latency = now > pts ? GST_TIME_AS_USECONDS (now - pts) : 0;
+
+    bucket = MIN (g_bit_storage (latency / 1000),
+                  MM_BACKEND_LATENCY_BUCKETS - 1);
+    g_atomic_int_inc (&priv->render_latency[bucket]);
+
+    do {
+        max = g_atomic_int_get (&priv->render_latency_max);
+    } while (latency > max &&
+             !g_atomic_int_compare_and_exchange (&priv->render_latency_max,
+                                                 max, latency));
+
+    return GST_PAD_PROBE_OK;
+}
+
+static void need_data_cb (GstAppSrc *src, guint length, gpointer user_data);
+static GstFlowReturn new_sample_cb (GstAppSink *sink, gpointer user_data);
+
+static const GstAppSrcCallbacks player_callbacks = { need_data_cb, };
+static const GstAppSinkCallbacks recorder_callbacks = { NULL, NULL, new_sample_cb, };
+static const GstAppSrcCallbacks no_player_callbacks;
+static const GstAppSinkCallbacks no_recorder_callbacks;
+
+/* Queues a reference to @buffer, in the call format, for the reader
+ * of @self. Only the producer of the recorder ring, the streaming
+ * thread of its pipeline or of the conference host, calls it.
+ * Returns %FALSE if the ring is full. */
+static gboolean
+capture_push (MmBackend *self, GstBuffer *buffer)
+{
+    MmBackendPrivate *priv = self->priv;
+    gsize size = gst_buffer_get_size (buffer);
+
+    if (g_atomic_int_get (&priv->captured) + size > priv->capture_size)
+        return FALSE;
+
+    gst_buffer_ref (buffer);
+    if (!mm_ring_write (priv->ring[MM_BACKEND_DIRECTION_RECORDER],
+                        (const guint8 *) &buffer, sizeof (buffer))) {
+        gst_buffer_unref (buffer);
+        return FALSE;
+    }
+
+    /* counted once the reference can be found */
+    g_atomic_int_add (&priv->captured, size);
+
+    return TRUE;
+}
+
+/* The reader's end of the recorder ring: copies up to @len bytes out
+ * of the mapped buffers into @dest, or discards them if it is %NULL.
+ * Returns the bytes taken. */
+static gsize
+capture_take (MmBackend *self, guint8 *dest, gsize len)
+{
+    MmBackendPrivate *priv = self->priv;
+    MmRing *ring = priv->ring[MM_BACKEND_DIRECTION_RECORDER];
+    GstBuffer *buffer;
+    gsize done = 0, n;
+
+    while (done < len) {
+        if (!priv->capture_buffer) {
+            if (!mm_ring_read (ring, (guint8 *) &buffer, sizeof (buffer)))
+                break;
+
+            if (!gst_buffer_map (buffer, &priv->capture_map, GST_MAP_READ)) {
+                g_atomic_int_add (&priv->captured,
+                                  - (gint) gst_buffer_get_size (buffer));
+                gst_buffer_unref (buffer);
+                continue;
+            }
+
+            priv->capture_buffer = buffer;
+            priv->capture_offset = 0;
+        }
+
+        n = MIN (len - done, priv->capture_map.size - priv->capture_offset);
+        if (dest) {
+            memcpy (dest + done, priv->capture_map.data + priv->capture_offset,
+                    n);
+        }
+        priv->capture_offset += n;
+        done += n;
+
+        if (priv->capture_offset == priv->capture_map.size) {
+            gst_buffer_unmap (priv->capture_buffer, &priv->capture_map);
+            gst_buffer_unref (priv->capture_buffer);
+            priv->capture_buffer = NULL;
+        }
+    }
+
+    g_atomic_int_add (&priv->captured, - (gint) done);
+
+    return done;
+}
+
+/* (re)creates the ring of @dir for the negotiated format. Neither the
+ * pipeline nor Opal use it at this point. */
+static void
+setup_ring (MmBackend *self, MmBackendDirection dir)
+{
+    MmBackendPrivate *priv = self->priv;
+    AudioFormat *format = &priv->format[dir];
+    gint64 duration = RING_DURATION;
+    gsize size;
+
+    if (dir == MM_BACKEND_DIRECTION_RECORDER)
+        duration = MAX (duration, g_atomic_int_get (&capture_depth));
+
+    size = gst_util_uint64_scale (format->rate * format->bpf, duration,
+                                  G_USEC_PER_SEC);
+
+    /* the recorder ring carries references: the bytes they hold are
+     * bounded apart */
+    if (dir == MM_BACKEND_DIRECTION_RECORDER) {
+        if (priv->ring[dir])
+            capture_take (self, NULL, G_MAXSIZE);
+        priv->capture_size = size;
+        size = CAPTURE_REFS * sizeof (GstBuffer *);
+    }
+
+    if (!priv->ring[dir] || mm_ring_get_size (priv->ring[dir]) < size) {
+        mm_ring_free (priv->ring[dir]);
+        priv->ring[dir] = mm_ring_new (size);
+    }
+
+    mm_ring_reset (priv->ring[dir]);
+}
+
+static gboolean
+setup_player (MmBackend *self, GstElement *pipe, GstCaps *caps)
+{
+    MmBackendPrivate *priv = self->priv;
+    GstElement *audio;
+
+    priv->appsrc = (GstAppSrc *) get_element (pipe, "opal-src");
+    priv->queue = get_element (pipe, "playout-queue");
+    audio = get_element (pipe, "audio-sink");
+
+    if (!priv->appsrc || !priv->queue || !audio) {
+        GST_ERROR ("player elements not found");
+        if (audio)
+            gst_object_unref (audio);
+        g_clear_object (&priv->appsrc);
+        g_clear_object (&priv->queue);
+        return FALSE;
+    }
+
+    priv->render_pad = gst_element_get_static_pad (audio, "sink");
+    priv->render_probe = gst_pad_add_probe (priv->render_pad,
+                                            GST_PAD_PROBE_TYPE_BUFFER,
+                                            render_probe_cb, self, NULL);
+    gst_object_unref (audio);
+
+    g_signal_connect (priv->queue, "underrun", G_CALLBACK (underrun_cb), self);
+    g_signal_connect (priv->queue, "overrun", G_CALLBACK (overrun_cb), self);
+
+    g_object_set (priv->appsrc, "caps", caps, NULL);
+    gst_caps_replace (&priv->caps, caps);
+    priv->pool_size = 0;
+
+    setup_ring (self, MM_BACKEND_DIRECTION_PLAYER);
+    priv->written = priv->pushed = 0;
+    priv->written_low = 0;
+    priv->frame_size = 0;
+    priv->rendered = 0;
+    priv->push_ret = GST_FLOW_OK;
+    priv->starved = FALSE;
+    gst_app_src_set_callbacks (priv->appsrc,
+                               (GstAppSrcCallbacks *) &player_callbacks,
+                               self, NULL);
+
+    priv->failed[MM_BACKEND_DIRECTION_PLAYER] = FALSE;
+    priv->ready[MM_BACKEND_DIRECTION_PLAYER] = FALSE;
+    priv->player = gst_object_ref (pipe);
+    apply_buffers (self, MM_BACKEND_DIRECTION_PLAYER);
+
+    return TRUE;
+}
+
+/* the call format first, then whatever the device can deliver that
+ * the backend converts itself */
+static GstCaps *
+get_capture_caps (GstCaps *caps, guint rate)
+{
+    GstCaps *capture;
+
+    capture = gst_caps_copy (caps);
+    gst_caps_append_structure (capture,
+        gst_structure_new_from_string ("audio/x-raw, "
+            "format = (string) { S16LE, F32LE, S32LE, S24LE }, "
+            "layout = (string) interleaved, "
+            "channels = (int) [ 1, 2 ]"));
+    gst_caps_set_simple (capture, "rate", G_TYPE_INT, rate, NULL);
+
+    return capture;
+}
+
+static gboolean
+setup_recorder (MmBackend *self, GstElement *pipe, GstCaps *caps)
+{
+    MmBackendPrivate *priv = self->priv;
+    GstCaps *capture;
+
+    priv->appsink = (GstAppSink *) get_element (pipe, "opal-sink");
+    if (!priv->appsink) {
+        GST_ERROR ("recorder elements not found");
+        return FALSE;
+    }
+
+    capture = get_capture_caps (caps,
+                                priv->format[MM_BACKEND_DIRECTION_RECORDER].rate);
+    g_object_set (priv->appsink, "caps", capture, NULL);
+    gst_caps_unref (capture);
+    priv->next_capture = GST_CLOCK_TIME_NONE;
+    priv->vad_hangover = 0;
+
+    setup_ring (self, MM_BACKEND_DIRECTION_RECORDER);
+    gst_app_sink_set_callbacks (priv->appsink,
+                                (GstAppSinkCallbacks *) &recorder_callbacks,
+                                self, NULL);
+
+    priv->failed[MM_BACKEND_DIRECTION_RECORDER] = FALSE;
+    priv->ready[MM_BACKEND_DIRECTION_RECORDER] = FALSE;
+    priv->recorder = gst_object_ref (pipe);
+    apply_buffers (self, MM_BACKEND_DIRECTION_RECORDER);
+
+    return TRUE;
+}
+
+/* synthetic and named devices are not cached; a WAV file needs the
+ * EOS to get its header written */
+static void
+shutdown_pipeline (GstElement *pipe, gboolean drain)
+{
+    GstBus *bus;
+    GstMessage *msg;
+
+    if (drain && gst_element_send_event (pipe, gst_event_new_eos ())) {
+        bus = gst_element_get_bus (pipe);
+        msg = gst_bus_timed_pop_filtered (bus, GST_SECOND,
+                                          GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+        if (msg)
+            gst_message_unref (msg);
+        gst_object_unref (bus);
+    }
+
+    gst_element_set_state (pipe, GST_STATE_NULL);
+    gst_object_unref (pipe);
+}
+
+/* gives the pipeline back to the cache once no direction uses it */
+static void
+release_pipeline (MmBackend *self, GstElement *pipe, MmBackendDirection dir)
+{
+    MmBackendPrivate *priv = self->priv;
+
+    if (pipe == priv->player || pipe == priv->recorder) {
+        priv->watch[dir] = NULL;
+        gst_object_unref (pipe);
+        return;
+    }
+
+    /* the watch holds the bus, and points to this backend */
+    if (priv->watch[dir]) {
+        remove_bus_watch (priv->watch[dir]);
+        priv->watch[dir] = NULL;
+    }
+
+    if (g_atomic_int_get (&priv->failed[dir]))
+        priv->kind = PIPELINE_LAST;
+
+    if (priv->kind == PIPELINE_LAST) {
+        gst_object_unref (pipe);
+        return;
+    }
+
+    if (priv->device) {
+        shutdown_pipeline (pipe, g_str_has_prefix (priv->device, DEVICE_WAV));
+        g_clear_pointer (&priv->device, g_free);
+        return;
+    }
+
+    cache_give (priv->kind, pipe, idle_state ());
+}
+
+static void
+close_player (MmBackend *self)
+{
+    MmBackendPrivate *priv = self->priv;
+    GstElement *pipe = priv->player;
+
+    if (!pipe)
+        return;
+
+    /* a duplex pipeline may keep running for the recorder */
+    gst_app_src_set_callbacks (priv->appsrc,
+                               (GstAppSrcCallbacks *) &no_player_callbacks,
+                               NULL, NULL);
+
+    if (priv->render_probe)
+        gst_pad_remove_probe (priv->render_pad, priv->render_probe);
+    priv->render_probe = 0;
+    g_clear_object (&priv->render_pad);
+
+    g_signal_handlers_disconnect_by_data (priv->queue, self);
+
+    gst_object_unref (priv->appsrc);
+    gst_object_unref (priv->queue);
+    g_mutex_lock (&priv->lock);
+    priv->player = NULL;
+    g_mutex_unlock (&priv->lock);
+    priv->appsrc = NULL;
+    priv->queue = NULL;
+
+    release_pipeline (self, pipe, MM_BACKEND_DIRECTION_PLAYER);
+
+    if (priv->pool) {
+        gst_buffer_pool_set_active (priv->pool, FALSE);
+        gst_object_unref (priv->pool);
+        priv->pool = NULL;
+    }
+
+    gst_caps_replace (&priv->caps, NULL);
+}
+
+static void
+close_recorder (MmBackend *self)
+{
+    MmBackendPrivate *priv = self->priv;
+    GstElement *pipe = priv->recorder;
+
+    if (!pipe)
+        return;
+
+    gst_app_sink_set_callbacks (priv->appsink,
+                                (GstAppSinkCallbacks *) &no_recorder_callbacks,
+                                NULL, NULL);
+
+    gst_object_unref (priv->appsink);
+    g_mutex_lock (&priv->lock);
+    priv->recorder = NULL;
+    g_mutex_unlock (&priv->lock);
+    priv->appsink = NULL;
+
+    release_pipeline (self, pipe, MM_BACKEND_DIRECTION_RECORDER);
+
+    /* release a reader waiting for the capture */
+    g_mutex_lock (&priv->lock);
+    g_cond_broadcast (&priv->cond);
+    g_mutex_unlock (&priv->lock);
+
+    gst_caps_replace (&priv->capture_caps, NULL);
+}
+
+/* the devices whose pipelines are not cached, %NULL for the others */
+static const gchar *
+own_device (const char *dev)
+{
+    if (dev && (g_str_equal (dev, DEVICE_TEST) ||
+                g_str_has_prefix (dev, DEVICE_WAV) ||
+                g_str_has_prefix (dev, DEVICE_NAMED)))
+        return dev;
+
+    return NULL;
+}
+
+static GstCaps *
+call_caps (guint rate, guint channels)
+{
+    return gst_caps_new_simple ("audio/x-raw",
+                                "layout", G_TYPE_STRING, "interleaved",
+                                "format", G_TYPE_STRING, "S16LE",
+                                "rate", G_TYPE_INT, rate,
+                                "channels", G_TYPE_INT, channels,
+                                NULL);
+}
+
+/* Opens @dir again on the duplex pipeline its other direction kept
+ * running since they were closed one at a time. */
+static gboolean
+reattach_direction (MmBackend *self, const char *dev, MmBackendDirection dir,
+                    guint channels, guint rate)
+{
+    MmBackendPrivate *priv = self->priv;
+    GstElement *pipe = priv->player ? priv->player : priv->recorder;
+    GstCaps *caps;
+    GstState state;
+    gboolean ret;
+
+    /* both directions share the device of the pipeline */
+    if (g_strcmp0 (own_device (dev), priv->device) != 0) {
+        GST_INFO ("direction %d stays on the device of direction %d",
+                  dir, !dir);
+    }
+
+    GST_INFO ("reattaching direction %d to the duplex pipeline", dir);
+
+    priv->format[dir].rate = rate;
+    priv->format[dir].bpf = channels * 2;
+    set_opened (self, dir, g_get_monotonic_time ());
+    reset_deadline (self, dir);
+
+    caps = call_caps (rate, channels);
+    if (dir == MM_BACKEND_DIRECTION_PLAYER)
+        ret = setup_player (self, pipe, caps);
+    else
+        ret = setup_recorder (self, pipe, caps);
+    gst_caps_unref (caps);
+
+    /* the half set up is undone, the other direction goes on */
+    if (!ret) {
+        GST_ERROR ("cannot reattach direction %d: close direction %d first",
+                   dir, !dir);
+        return FALSE;
+    }
+
+    priv->watch[dir] = priv->watch[!dir];
+
+    /* no state change is coming to tell it */
+    gst_element_get_state (pipe, &state, NULL, 0);
+    if (state == GST_STATE_PLAYING)
+        set_ready (self, dir);
+
+    return TRUE;
+}
+
+gboolean
+mm_backend_audio_open (MmBackend *self,
+                       const char *dev,
+                       MmBackendDirection dir,
+                       guint channels,
+                       guint rate,
+                       guint bits)
+{
+    GST_INFO ("opening device %s / direction = %d", dev, dir);
+
+    MmBackendPrivate *priv = self->priv;
+    GstCaps *caps;
+    GstStateChangeReturn ret;
+    GstElement *pipe;
+    gboolean player, recorder;
+    gint64 now = g_get_monotonic_time ();
+
+    if (dir != MM_BACKEND_DIRECTION_PLAYER &&
+        dir != MM_BACKEND_DIRECTION_RECORDER)
+        return FALSE;
+
+    /* other device formats are converted to this in the recorder */
+    if (bits != 16 || channels < 1 || channels > 2) {
+        GST_WARNING ("unsupported call format: %u bits, %u channels",
+                     bits, channels);
+        return FALSE;
+    }
+
+    if ((dir == MM_BACKEND_DIRECTION_PLAYER && priv->player) ||
+        (dir == MM_BACKEND_DIRECTION_RECORDER && priv->recorder) ||
+        priv->leg[dir]) {
+        GST_INFO("player / recorder already exists");
+        return TRUE;
+    }
+
+    if (priv->conference)
+        return conference_join (self, dev, dir, channels, rate);
+
+    /* the other direction was left running */
+    if (priv->duplex && (priv->player || priv->recorder))
+        return reattach_direction (self, dev, dir, channels, rate);
+
+    /* in duplex mode the first direction opened brings up both */
+    player = priv->duplex || dir == MM_BACKEND_DIRECTION_PLAYER;
+    recorder = priv->duplex || dir == MM_BACKEND_DIRECTION_RECORDER;
+
+    if (priv->duplex)
+        priv->kind = PIPELINE_DUPLEX;
+    else if (player)
+        priv->kind = PIPELINE_PLAYER;
+    else
+        priv->kind = PIPELINE_RECORDER;
+
+    if (own_device (dev))
+        priv->device = g_strdup (dev);
+
+    pipe = priv->device ? NULL : cache_take (priv->kind);
+    if (!pipe)
+        pipe = build_pipeline (priv->kind, priv->device);
+    if (!pipe) {
+        g_clear_pointer (&priv->device, g_free);
+        return FALSE;
+    }
+
+    caps = call_caps (rate, channels);
+
+    if (player) {
+        priv->format[MM_BACKEND_DIRECTION_PLAYER].rate = rate;
+        priv->format[MM_BACKEND_DIRECTION_PLAYER].bpf = channels * 2;
+        set_opened (self, MM_BACKEND_DIRECTION_PLAYER, now);
+        reset_deadline (self, MM_BACKEND_DIRECTION_PLAYER);
+        if (!setup_player (self, pipe, caps))
+            goto bail;
+    }
+
+    if (recorder) {
+        priv->format[MM_BACKEND_DIRECTION_RECORDER].rate = rate;
+        priv->format[MM_BACKEND_DIRECTION_RECORDER].bpf = channels * 2;
+        set_opened (self, MM_BACKEND_DIRECTION_RECORDER, now);
+        reset_deadline (self, MM_BACKEND_DIRECTION_RECORDER);
+        if (!setup_recorder (self, pipe, caps))
+            goto bail;
+    }
+
+    gst_caps_unref (caps);
+
+    priv->watch[dir] = add_bus_watch (self, pipe);
+    if (priv->duplex)
+        priv->watch[!dir] = priv->watch[dir];
+
+    /* a cached pipeline is already prerolled: this only flips it */
+    ret = gst_element_set_state (pipe, GST_STATE_PLAYING);
+    gst_object_unref (pipe);
+
+    GST_INFO ("change state is %s",
+              gst_element_state_change_return_get_name(ret));
+
+    return (ret == GST_STATE_CHANGE_SUCCESS || ret == GST_STATE_CHANGE_ASYNC);
+
+bail:
+    gst_caps_unref (caps);
+
+    /* a broken pipeline must not go back to the cache */
+    priv->kind = PIPELINE_LAST;
+    close_player (self);
+    g_clear_pointer (&priv->device, g_free);
+
+    gst_element_set_state (pipe, GST_STATE_NULL);
+    gst_object_unref (pipe);
+    return FALSE;
+}
+
+/* lets the Opal threads parked by the hold go */
+static void
+release_hold (MmBackend *self)
+{
+    MmBackendPrivate *priv = self->priv;
+
+    g_mutex_lock (&priv->lock);
+    g_atomic_int_set (&priv->held, FALSE);
+    g_cond_broadcast (&priv->cond);
+    g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * mm_backend_set_hold:
+ * @self: a #MmBackend instance
+ * @hold: whether the call is on hold
+ *
+ * Parks the pipelines in PAUSED while the call is on hold, and the
+ * Opal threads in mm_backend_audio_write() and mm_backend_audio_read()
+ * with them, so a held call costs no wakeups per frame. A conference
+ * leg only parks its threads: the conference goes on for the others.
+ *
+ * Resuming sets the pipelines back to PLAYING and releases the parked
+ * threads at once; the capture queued before the hold is discarded.
+ * Closing the backend resumes it too.
+ */
+void
+mm_backend_set_hold (MmBackend *self,
+                     gboolean hold)
+{
+    g_return_if_fail (MM_IS_BACKEND (self));
+
+    MmBackendPrivate *priv = self->priv;
+    GstState state = hold ? GST_STATE_PAUSED : GST_STATE_PLAYING;
+    GstElement *player = NULL, *recorder = NULL;
+
+    if (g_atomic_int_get (&priv->held) == !!hold)
+        return;
+
+    GST_INFO ("%s", hold ? "holding" : "resuming");
+
+    if (hold)
+        g_atomic_int_set (&priv->held, TRUE);
+
+    /* the pipelines may be closing in an Opal thread */
+    g_mutex_lock (&priv->lock);
+    if (priv->player)
+        player = gst_object_ref (priv->player);
+    if (priv->recorder && priv->recorder != priv->player)
+        recorder = gst_object_ref (priv->recorder);
+    g_mutex_unlock (&priv->lock);
+
+    if (player) {
+        gst_element_set_state (player, state);
+        gst_object_unref (player);
+    }
+    if (recorder) {
+        gst_element_set_state (recorder, state);
+        gst_object_unref (recorder);
+    }
+
+    if (!hold) {
+        reset_deadline (self, MM_BACKEND_DIRECTION_PLAYER);
+        reset_deadline (self, MM_BACKEND_DIRECTION_RECORDER);
+        g_atomic_int_set (&priv->flush_capture, TRUE);
+        release_hold (self);
+    }
+}
+
+/**
+ * mm_backend_get_hold:
+ * @self: a #MmBackend instance
+ *
+ * Returns: %TRUE if the backend is on hold
+ */
+gboolean
+mm_backend_get_hold (MmBackend *self)
+{
+    g_return_val_if_fail (MM_IS_BACKEND (self), FALSE);
+
+    return g_atomic_int_get (&self->priv->held);
+}
+
+/* how long a switch waits for the data flow to let the pad block */
+#define SWITCH_BLOCK_TIMEOUT (200 * G_TIME_SPAN_MILLISECOND)
+
+typedef struct {
+    GMutex lock;
+    GCond cond;
+    gboolean blocked;
+} PadBlock;
+
+static GstPadProbeReturn
+pad_blocked_cb (GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+    PadBlock *block = data;
+
+    g_mutex_lock (&block->lock);
+    block->blocked = TRUE;
+    g_cond_signal (&block->cond);
+    g_mutex_unlock (&block->lock);
+
+    /* the data flow waits until the probe is removed */
+    return GST_PAD_PROBE_OK;
+}
+
+/* Blocks @pad as soon as no buffer goes through it, which is at once
+ * if the pipeline is paused. Returns the probe, or 0 on timeout. */
+static gulong
+block_pad (GstPad *pad, PadBlock *block)
+{
+    gint64 deadline = g_get_monotonic_time () + SWITCH_BLOCK_TIMEOUT;
+    gulong probe;
+
+    block->blocked = FALSE;
+    probe = gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_IDLE, pad_blocked_cb,
+                               block, NULL);
+
+    g_mutex_lock (&block->lock);
+    while (!block->blocked) {
+        if (!g_cond_wait_until (&block->cond, &block->lock, deadline))
+            break;
+    }
+    g_mutex_unlock (&block->lock);
+
+    if (block->blocked || !probe)
+        return probe;
+
+    gst_pad_remove_probe (pad, probe);
+    return 0;
+}
+
+/* The device element of @dir for @device, built apart and in READY,
+ * so the device is open before the pipeline is blocked. */
+static GstElement *
+prepare_device (MmBackendDirection dir, const gchar *name, const char *device)
+{
+    GstElement *holder, *element;
+
+    holder = gst_object_ref_sink (gst_bin_new (NULL));
+    element = add_audio_element (holder, dir, name, device);
+    if (element) {
+        gst_object_ref (element);
+        gst_bin_remove (GST_BIN (holder), element);
+    }
+    gst_object_unref (holder);
+
+    if (!element)
+        return NULL;
+
+    if (gst_element_set_state (element, GST_STATE_READY) ==
+        GST_STATE_CHANGE_FAILURE) {
+        GST_ERROR ("cannot open the device %s", device ? device : "Gst");
+        gst_element_set_state (element, GST_STATE_NULL);
+        gst_object_unref (element);
+        return NULL;
+    }
+
+    return element;
+}
+
+/* Swaps @old for @element in @pipe. @pad is the pad of the pipeline
+ * linked to @old, blocked, and @old_pad the one of @old. */
+static gboolean
+swap_device (GstElement *pipe, GstElement *old, GstPad *old_pad,
+             GstElement *element, GstPad *pad)
+{
+    GstPad *new_pad;
+    gboolean ret;
+
+    /* in the case of a source, this releases its streaming thread,
+     * blocked in the probe */
+    gst_element_set_state (old, GST_STATE_NULL);
+    gst_bin_remove (GST_BIN (pipe), old);
+
+    gst_bin_add (GST_BIN (pipe), element);
+    new_pad = gst_element_get_static_pad (element,
+                                          GST_PAD_IS_SRC (old_pad) ? "src" : "sink");
+    ret = new_pad &&
+        GST_PAD_LINK_SUCCESSFUL (GST_PAD_IS_SRC (new_pad) ?
+                                 gst_pad_link (new_pad, pad) :
+                                 gst_pad_link (pad, new_pad));
+    if (new_pad)
+        gst_object_unref (new_pad);
+
+    gst_element_sync_state_with_parent (element);
+
+    return ret;
+}
+
+/**
+ * mm_backend_switch_device:
+ * @self: a #MmBackend instance
+ * @dir: the direction to move
+ * @device: the device, as given to mm_backend_audio_open()
+ *
+ * Moves @dir to @device in the middle of a call. Only the sink, or the
+ * source, of the pipeline is replaced: the pad next to it is blocked
+ * while they are swapped, so the appsrc and the appsink, and the audio
+ * queued for Opal, are left as they are. The new device is opened
+ * before the pad is blocked, so the gap, kept in the
+ * device_switch_gap counter, is the time it takes to start. A leg of
+ * the conference moves the whole conference.
+ *
+ * The clock of the pipeline, if the old device provided it, is
+ * replaced too.
+ *
+ * Returns: %TRUE if @dir now runs on @device
+ */
+gboolean
+mm_backend_switch_device (MmBackend *self,
+                          MmBackendDirection dir,
+                          const char *device)
+{
+    g_return_val_if_fail (MM_IS_BACKEND (self), FALSE);
+
+    MmBackendPrivate *priv = self->priv;
+    const gchar *name;
+    GstElement *pipe = NULL, *old = NULL, *element = NULL;
+    GstPad *old_pad = NULL, *pad = NULL;
+    MmBackend *host = NULL;
+    PadBlock block;
+    gulong probe;
+    gint64 start, gap;
+    gboolean ret = FALSE;
+
+    if (dir != MM_BACKEND_DIRECTION_PLAYER &&
+        dir != MM_BACKEND_DIRECTION_RECORDER)
+        return FALSE;
+
+    if (priv->leg[dir]) {
+        g_mutex_lock (&conference_lock);
+        if (conference_host)
+            host = g_object_ref (conference_host);
+        g_mutex_unlock (&conference_lock);
+
+        if (!host)
+            return FALSE;
+
+        ret = mm_backend_switch_device (host, dir, device);
+        g_object_unref (host);
+        return ret;
+    }
+
+    /* "Gst" is the default device */
+    if (device && g_str_equal (device, "Gst"))
+        device = NULL;
+
+    /* the synthetic devices are not switched to, nor from */
+    if ((device && !g_str_has_prefix (device, DEVICE_NAMED)) ||
+        (priv->device && !g_str_has_prefix (priv->device, DEVICE_NAMED)))
+        return FALSE;
+
+    GST_INFO ("switching direction %d to %s", dir, device ? device : "Gst");
+
+    g_mutex_lock (&priv->switch_lock);
+
+    pipe = dir == MM_BACKEND_DIRECTION_PLAYER ? priv->player : priv->recorder;
+    if (!pipe)
+        goto out;
+
+    name = dir == MM_BACKEND_DIRECTION_PLAYER ? "audio-sink" : "audio-src";
+    old = get_element (pipe, name);
+    if (old)
+        old_pad = gst_element_get_static_pad (old,
+                                              dir == MM_BACKEND_DIRECTION_PLAYER ?
+                                              "sink" : "src");
+    if (old_pad)
+        pad = gst_pad_get_peer (old_pad);
+    if (!pad) {
+        GST_ERROR ("cannot find the device of direction %d", dir);
+        goto out;
+    }
+
+    element = prepare_device (dir, name, device);
+    if (!element)
+        goto out;
+
+    /* a sink is blocked from upstream, a source on its own pad */
+    g_mutex_init (&block.lock);
+    g_cond_init (&block.cond);
+    probe = block_pad (dir == MM_BACKEND_DIRECTION_PLAYER ? pad : old_pad,
+                       &block);
+
+    if (probe) {
+        start = g_get_monotonic_time ();
+
+        if (dir == MM_BACKEND_DIRECTION_PLAYER) {
+            if (priv->render_probe)
+                gst_pad_remove_probe (priv->render_pad, priv->render_probe);
+            priv->render_probe = 0;
+            g_clear_object (&priv->render_pad);
+        }
+
+        ret = swap_device (pipe, old, old_pad, element, pad);
+
+        if (dir == MM_BACKEND_DIRECTION_PLAYER) {
+            priv->render_pad = gst_element_get_static_pad (element, "sink");
+            priv->render_probe = gst_pad_add_probe (priv->render_pad,
+                                                    GST_PAD_PROBE_TYPE_BUFFER,
+                                                    render_probe_cb, self, NULL);
+            gst_pad_remove_probe (pad, probe);
+        } else {
+            gst_pad_remove_probe (old_pad, probe);
+        }
+
+        gap = g_get_monotonic_time () - start;
+        g_mutex_lock (&priv->lock);
+        priv->stats.device_switch_gap = gap;
+        g_mutex_unlock (&priv->lock);
+        reset_deadline (self, dir);
+        GST_INFO ("switched in %" G_GINT64_FORMAT " us", gap);
+
+        /* the pipeline is not on the device of its kind anymore */
+        if (!priv->device)
+            priv->device = g_strdup (device ? device : DEVICE_NAMED);
+    } else {
+        GST_WARNING ("the data flow did not let direction %d block", dir);
+        gst_element_set_state (element, GST_STATE_NULL);
+    }
+
+    g_mutex_clear (&block.lock);
+    g_cond_clear (&block.cond);
+
+out:
+    g_mutex_unlock (&priv->switch_lock);
+
+    if (element)
+        gst_object_unref (element);
+    if (pad)
+        gst_object_unref (pad);
+    if (old_pad)
+        gst_object_unref (old_pad);
+    if (old)
+        gst_object_unref (old);
+
+    return ret;
+}
+
+gboolean
+mm_backend_audio_is_open (MmBackend *self)
+{
+    MmBackendPrivate *priv = self->priv;
+
+    return priv->player || priv->recorder ||
+        priv->leg[MM_BACKEND_DIRECTION_PLAYER] ||
+        priv->leg[MM_BACKEND_DIRECTION_RECORDER];
+}
+
+gboolean
+mm_backend_audio_is_direction_open (MmBackend *self,
+                                    MmBackendDirection dir)
+{
+    MmBackendPrivate *priv = self->priv;
+
+    if (dir == MM_BACKEND_DIRECTION_PLAYER)
+        return priv->player || priv->leg[dir];
+    if (dir == MM_BACKEND_DIRECTION_RECORDER)
+        return priv->recorder || priv->leg[dir];
+
+    return FALSE;
+}
+
+MmBackend *
+mm_backend_new (void)
+{
+    return g_object_new (MM_TYPE_BACKEND, NULL);
+}
+
+gboolean
+mm_backend_audio_close (MmBackend *self)
+{
+    GST_INFO ("closing audio devices");
+
+    release_hold (self);
+    mm_backend_audio_close_direction (self, MM_BACKEND_DIRECTION_PLAYER);
+    mm_backend_audio_close_direction (self, MM_BACKEND_DIRECTION_RECORDER);
+
+    return TRUE;
+}
+
+/**
+ * mm_backend_audio_close_direction:
+ * @self: a #MmBackend instance
+ * @dir: the direction to close
+ *
+ * Closes @dir only; in duplex mode the pipeline keeps running for the
+ * other direction, if it is still open, and opening @dir again joins
+ * it. Otherwise the pipeline is handled as the idle policy says.
+ *
+ * It may be called while another thread reads or writes @dir: that
+ * thread is woken up, and the close waits for it to return.
+ *
+ * Returns: %TRUE
+ */
+gboolean
+mm_backend_audio_close_direction (MmBackend *self,
+                                  MmBackendDirection dir)
+{
+    g_return_val_if_fail (MM_IS_BACKEND (self), FALSE);
+
+    MmBackendPrivate *priv = self->priv;
+
+    if (dir != MM_BACKEND_DIRECTION_PLAYER &&
+        dir != MM_BACKEND_DIRECTION_RECORDER)
+        return FALSE;
+
+    GST_INFO ("closing direction %d", dir);
+
+    g_atomic_int_set (&priv->closing[dir], TRUE);
+    g_mutex_lock (&priv->lock);
+    g_cond_broadcast (&priv->cond);
+    while (g_atomic_int_get (&priv->busy[dir]) > 0)
+        g_cond_wait (&priv->cond, &priv->lock);
+    g_mutex_unlock (&priv->lock);
+
+    g_mutex_lock (&priv->switch_lock);
+    conference_leave (self, dir);
+    if (dir == MM_BACKEND_DIRECTION_PLAYER) {
+        close_player (self);
+    } else {
+        close_recorder (self);
+        /* the buffers Opal did not read */
+        if (priv->ring[dir])
+            capture_take (self, NULL, G_MAXSIZE);
+    }
+    g_mutex_unlock (&priv->switch_lock);
+
+    g_atomic_int_set (&priv->closing[dir], FALSE);
+
+    return TRUE;
+}
+
+/**
+ * mm_backend_prewarm:
+ * @duplex: whether the next call will use the duplex mode
+ *
+ * Builds, in the background, the pipelines the next call will need
+ * and leaves them prerolled in the cache, so opening the call's audio
+ * only has to set them to PLAYING. It does nothing if the cache
+ * already holds them.
+ *
+ * It is meant to be called as soon as a call starts ringing.
+ */
+void
+mm_backend_prewarm (gboolean duplex)
+{
+    check_gstreamer ();
+
+    if (duplex) {
+        prewarm (PIPELINE_DUPLEX);
+    } else {
+        prewarm (PIPELINE_PLAYER);
+        prewarm (PIPELINE_RECORDER);
+    }
+}
+
+/**
+ * mm_backend_clear_cache:
+ *
+ * Shuts down all the pipelines kept in the cache.
+ */
+void
+mm_backend_clear_cache (void)
+{
+    GstElement *pipe;
+    guint i;
+
+    for (i = 0; i < PIPELINE_LAST; i++) {
+        while ((pipe = cache_take (i))) {
+            gst_element_set_state (pipe, GST_STATE_NULL);
+            gst_object_unref (pipe);
+        }
+    }
+}
+
+/* gives the idle pipelines back to the cache, which sets them up for
+ * the current policies; those in PAUSED start their threads again */
+static void
+recycle_cache (void)
+{
+    GQueue idle = G_QUEUE_INIT;
+    GstElement *pipe;
+    guint i;
+
+    for (i = 0; i < PIPELINE_LAST; i++) {
+        g_mutex_lock (&cache_lock);
+        idle = pipeline_cache[i];
+        g_queue_init (&pipeline_cache[i]);
+        g_mutex_unlock (&cache_lock);
+
+        while ((pipe = g_queue_pop_head (&idle)))
+            cache_give (i, pipe, idle_state ());
+    }
+}
+
+/**
+ * mm_backend_set_idle_policy:
+ * @policy: what to do with the pipelines between calls
+ *
+ * Tearing the pipelines down saves the most while the phone is idle,
+ * but the next call has to build them again. In READY they are built
+ * but the devices are closed, so nothing captures nor wakes up. Warm,
+ * the default, they stay prerolled in PAUSED with the devices open,
+ * and the next call only has to set them to PLAYING.
+ *
+ * The pipelines already idle are moved to the new policy. Those built
+ * by mm_backend_prewarm() are kept at least in READY.
+ */
+void
+mm_backend_set_idle_policy (MmBackendIdlePolicy policy)
+{
+    g_return_if_fail (policy <= MM_BACKEND_IDLE_WARM);
+
+    if (g_atomic_int_get (&idle_policy) == (gint) policy)
+        return;
+
+    GST_INFO ("idle policy %d", policy);
+    g_atomic_int_set (&idle_policy, policy);
+
+    recycle_cache ();
+}
+
+MmBackendIdlePolicy
+mm_backend_get_idle_policy (void)
+{
+    return g_atomic_int_get (&idle_policy);
+}
+
+/**
+ * mm_backend_set_realtime:
+ * @policy: how to schedule the threads moving the audio
+ * @priority: the SCHED_RR or SCHED_FIFO priority, or the niceness
+ *
+ * Schedules the streaming threads of the pipelines, and the Opal
+ * threads reading and writing the audio, ahead of the rest of the
+ * system, so that the load of other programs delays them less; the
+ * deadline_misses counter tells by how much. The real-time policies
+ * need the CAP_SYS_NICE capability or an RLIMIT_RTPRIO allowing
+ * @priority; without them, the threads get the niceness of rtkit
+ * instead. SCHED_RR is the safer: a thread spinning at the same
+ * priority does not starve the others.
+ *
+ * The threads are scheduled as they start moving audio, so the policy
+ * applies from the next call; the pipelines kept idle are restarted
+ * for it. As the threads are reused, %MM_BACKEND_REALTIME_NONE gives
+ * them back the scheduling, niceness and CPUs of the process, once a
+ * policy or a CPU set was applied.
+ */
+void
+mm_backend_set_realtime (MmBackendRealtime policy, gint priority)
+{
+    g_return_if_fail (policy <= MM_BACKEND_REALTIME_FIFO);
+
+    switch (policy) {
+    case MM_BACKEND_REALTIME_NICE:
+        priority = CLAMP (priority, -20, 0);
+        break;
+    case MM_BACKEND_REALTIME_RR:
+    case MM_BACKEND_REALTIME_FIFO:
+        priority = CLAMP (priority,
+                          sched_get_priority_min (SCHED_RR),
+                          sched_get_priority_max (SCHED_RR));
+        break;
+    default:
+        priority = 0;
+        break;
+    }
+
+    g_mutex_lock (&realtime_lock);
+    if (realtime_policy == policy && realtime_priority == priority) {
+        g_mutex_unlock (&realtime_lock);
+        return;
+    }
+    realtime_policy = policy;
+    realtime_priority = priority;
+    g_atomic_int_inc (&realtime_generation);
+    g_mutex_unlock (&realtime_lock);
+
+    GST_INFO ("real-time policy %d, priority %d", policy, priority);
+    recycle_cache ();
+}
+
+/**
+ * mm_backend_get_realtime:
+ * @priority: (out) (allow-none): the priority, or the niceness
+ *
+ * Returns: how the threads moving the audio are scheduled
+ */
+MmBackendRealtime
+mm_backend_get_realtime (gint *priority)
+{
+    MmBackendRealtime policy;
+
+    g_mutex_lock (&realtime_lock);
+    policy = realtime_policy;
+    if (priority)
+        *priority = realtime_priority;
+    g_mutex_unlock (&realtime_lock);
+
+    return policy;
+}
+
+/* parses a list of CPUs as the kernel prints it, such as "0,2-3" */
+static gboolean
+parse_cpus (const gchar *list, cpu_set_t *cpus)
+{
+    gchar **ranges, **range;
+    gboolean ret = TRUE;
+
+    CPU_ZERO (cpus);
+
+    ranges = g_strsplit (list, ",", -1);
+    for (range = ranges; *range && ret; range++) {
+        guint64 first, last;
+        gchar *end;
+
+        first = g_ascii_strtoull (*range, &end, 10);
+        last = first;
+        if (end != *range && *end == '-') {
+            gchar *start = end + 1;
+
+            last = g_ascii_strtoull (start, &end, 10);
+            if (end == start)
+                end = start - 1;
+        }
+
+        ret = end != *range && *end == '\0' &&
+            first <= last && last < CPU_SETSIZE;
+        for (; ret && first <= last; first++)
+            CPU_SET (first, cpus);
+    }
+    g_strfreev (ranges);
+
+    return ret && CPU_COUNT (cpus) > 0;
+}
+
+/**
+ * mm_backend_set_cpu_affinity:
+ * @cpus: (allow-none): the CPUs, as "0,2-3", or %NULL for any
+ *
+ * Pins the threads moving the audio, as mm_backend_set_realtime()
+ * schedules them, to @cpus, meant to be kept away from the rest of the
+ * load. It applies from the next call too; %NULL gives them back the
+ * CPUs of the process.
+ *
+ * Returns: %FALSE if @cpus is not a list of CPUs
+ */
+gboolean
+mm_backend_set_cpu_affinity (const gchar *cpus)
+{
+    cpu_set_t set;
+    gboolean pinned = cpus && *cpus;
+
+    if (pinned && !parse_cpus (cpus, &set)) {
+        GST_WARNING ("not a list of CPUs: %s", cpus);
+        return FALSE;
+    }
+
+    g_mutex_lock (&realtime_lock);
+    realtime_pinned = pinned;
+    if (pinned)
+        realtime_cpus = set;
+    g_atomic_int_inc (&realtime_generation);
+    g_mutex_unlock (&realtime_lock);
+
+    GST_INFO ("audio threads pinned to %s", pinned ? cpus : "any CPU");
+    recycle_cache ();
+
+    return TRUE;
+}
+
+/**
+ * mm_backend_set_audio_element:
+ * @dir: the direction of the device
+ * @description: (allow-none): an element factory name, such as
+ * "pulsesink" or "alsasrc", or a gst-launch style pipeline fragment
+ * with one unlinked pad; %NULL goes back to the automatic device
+ *
+ * Picks the audio device used by every backend opened from now on.
+ * Pipelines already kept in the cache are discarded.
+ *
+ * Returns: %FALSE if @description cannot be parsed
+ */
+gboolean
+mm_backend_set_audio_element (MmBackendDirection dir, const gchar *description)
+{
+    GstElement *element;
+    GError *error = NULL;
+
+    g_return_val_if_fail (dir == MM_BACKEND_DIRECTION_PLAYER ||
+                          dir == MM_BACKEND_DIRECTION_RECORDER, FALSE);
+
+    check_gstreamer ();
+
+    if (description) {
+        element = gst_parse_bin_from_description (description, TRUE, &error);
+        if (element)
+            gst_object_unref (gst_object_ref_sink (element));
+        if (error) {
+            GST_ERROR ("cannot parse %s: %s", description, error->message);
+            g_error_free (error);
+            return FALSE;
+        }
+    }
+
+    g_mutex_lock (&cache_lock);
+    g_free (device_config[dir].description);
+    device_config[dir].description = g_strdup (description);
+    g_mutex_unlock (&cache_lock);
+
+    mm_backend_clear_cache ();
+
+    return TRUE;
+}
+
+/**
+ * mm_backend_set_audio_timing:
+ * @dir: the direction of the device
+ * @latency_time: microseconds of audio per device period, or 0
+ * @buffer_time: microseconds of audio held by the device, or 0
+ *
+ * Sets the latency-time and buffer-time of the audio device used by
+ * every backend opened from now on. Audio sinks default to 200 ms of
+ * buffering, which is far too much for a call; 0 keeps the element
+ * default. Pipelines already kept in the cache are discarded.
+ */
+void
+mm_backend_set_audio_timing (MmBackendDirection dir,
+                             gint64 latency_time,
+                             gint64 buffer_time)
+{
+    g_return_if_fail (dir == MM_BACKEND_DIRECTION_PLAYER ||
+                      dir == MM_BACKEND_DIRECTION_RECORDER);
+
+    g_mutex_lock (&cache_lock);
+    device_config[dir].latency_time = MAX (latency_time, 0);
+    device_config[dir].buffer_time = MAX (buffer_time, 0);
+    g_mutex_unlock (&cache_lock);
+
+    mm_backend_clear_cache ();
+}
+
+/**
+ * mm_backend_get_device_latency:
+ * @dir: the direction of the device
+ *
+ * Returns: the buffering, in microseconds, the audio device reported
+ * the last time a pipeline for @dir was negotiated, or -1 if none has
+ * been yet
+ */
+gint64
+mm_backend_get_device_latency (MmBackendDirection dir)
+{
+    gint64 latency;
+
+    g_return_val_if_fail (dir == MM_BACKEND_DIRECTION_PLAYER ||
+                          dir == MM_BACKEND_DIRECTION_RECORDER, -1);
+
+    g_mutex_lock (&cache_lock);
+    latency = device_latency[dir];
+    g_mutex_unlock (&cache_lock);
+
+    return latency;
+}
+
+static gboolean
+has_device_name (GPtrArray *names, const gchar *name)
+{
+    guint i;
+
+    for (i = 0; i < names->len; i++) {
+        if (g_str_equal (g_ptr_array_index (names, i), name))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/* a device name unique in @names, as two identical headsets show up
+ * with the same display name */
+static gchar *
+unique_device_name (GPtrArray *names, GstDevice *device)
+{
+    gchar *display, *name;
+    guint n = 1;
+
+    display = gst_device_get_display_name (device);
+    name = g_strdup (display);
+
+    while (has_device_name (names, name)) {
+        g_free (name);
+        name = g_strdup_printf ("%s (%u)", display, ++n);
+    }
+
+    g_free (display);
+
+    return name;
+}
+
+/* Rebuilds the device lists from what the started monitor already
+ * knows: its providers keep the devices, so this does not go to the
+ * sound server. */
+static void
+refresh_devices (void)
+{
+    GPtrArray *names[2], *objects[2];
+    GList *devices, *l;
+    guint i;
+
+    for (i = 0; i < 2; i++) {
+        names[i] = g_ptr_array_new_with_free_func (g_free);
+        objects[i] = g_ptr_array_new_with_free_func (gst_object_unref);
+    }
+
+    devices = gst_device_monitor_get_devices (device_monitor);
+    for (l = devices; l; l = l->next) {
+        GstDevice *device = l->data;
+
+        if (gst_device_has_classes (device, "Audio/Sink"))
+            i = MM_BACKEND_DIRECTION_PLAYER;
+        else if (gst_device_has_classes (device, "Audio/Source"))
+            i = MM_BACKEND_DIRECTION_RECORDER;
+        else
+            continue;
+
+        g_ptr_array_add (names[i], unique_device_name (names[i], device));
+        g_ptr_array_add (objects[i], gst_object_ref (device));
+    }
+    g_list_free_full (devices, gst_object_unref);
+
+    /* swaps the new lists in, and keeps the old ones to free */
+    g_mutex_lock (&devices_lock);
+    for (i = 0; i < 2; i++) {
+        GPtrArray *old_names = device_names[i];
+        GPtrArray *old_objects = device_objects[i];
+
+        device_names[i] = names[i];
+        device_objects[i] = objects[i];
+        names[i] = old_names;
+        objects[i] = old_objects;
+    }
+    GST_INFO ("%u playback and %u capture devices",
+              device_names[MM_BACKEND_DIRECTION_PLAYER]->len,
+              device_names[MM_BACKEND_DIRECTION_RECORDER]->len);
+    g_mutex_unlock (&devices_lock);
+
+    for (i = 0; i < 2; i++) {
+        if (names[i])
+            g_ptr_array_unref (names[i]);
+        if (objects[i])
+            g_ptr_array_unref (objects[i]);
+    }
+}
+
+/* runs in the bus thread */
+static gboolean
+device_bus_cb (GstBus *bus, GstMessage *msg, gpointer data)
+{
+    switch (GST_MESSAGE_TYPE (msg)) {
+    case GST_MESSAGE_DEVICE_ADDED:
+    case GST_MESSAGE_DEVICE_REMOVED:
+#if GST_CHECK_VERSION (1, 16, 0)
+    case GST_MESSAGE_DEVICE_CHANGED:
+#endif
+        refresh_devices ();
+        break;
+    default:
+        break;
+    }
+
+    return TRUE;
+}
+
+/* starting the providers may take a while to reach the sound server */
+static gpointer
+monitor_thread (gpointer data)
+{
+    GstDeviceMonitor *monitor;
+    GstBus *bus;
+    GSource *source;
+
+    monitor = gst_device_monitor_new ();
+    gst_device_monitor_add_filter (monitor, "Audio/Sink", NULL);
+    gst_device_monitor_add_filter (monitor, "Audio/Source", NULL);
+
+    if (!gst_device_monitor_start (monitor)) {
+        GST_WARNING ("cannot monitor the sound devices");
+        gst_object_unref (monitor);
+        return NULL;
+    }
+
+    device_monitor = monitor;
+    refresh_devices ();
+
+    /* the changes queued meanwhile are handled by the watch */
+    bus = gst_device_monitor_get_bus (monitor);
+    source = gst_bus_create_watch (bus);
+    g_source_set_callback (source, (GSourceFunc) device_bus_cb, NULL, NULL);
+    g_source_attach (source, bus_context);
+    g_source_unref (source);
+    gst_object_unref (bus);
+
+    return NULL;
+}
+
+/**
+ * mm_backend_monitor_devices:
+ *
+ * Starts watching the sound devices in the background, so that
+ * mm_backend_get_devices() follows them as they are plugged and
+ * unplugged. Calling it again does nothing.
+ */
+void
+mm_backend_monitor_devices (void)
+{
+    static gsize started = 0;
+
+    check_gstreamer ();
+
+    if (g_once_init_enter (&started)) {
+        g_thread_unref (g_thread_new ("mm-devices", monitor_thread, NULL));
+        g_once_init_leave (&started, 1);
+    }
+}
+
+/**
+ * mm_backend_get_devices:
+ * @dir: the direction of the devices
+ *
+ * Lists the devices of @dir as the monitor last saw them; the list is
+ * empty until mm_backend_monitor_devices() is called and the devices
+ * are first seen. Each one is opened as "Gst:dev=" followed by its
+ * name. It only takes a reference: it neither probes the devices nor
+ * copies the list.
+ *
+ * Returns: (transfer full) (element-type utf8): the names of the
+ * devices, not to be modified
+ */
+GPtrArray *
+mm_backend_get_devices (MmBackendDirection dir)
+{
+    GPtrArray *names;
+
+    g_return_val_if_fail (dir == MM_BACKEND_DIRECTION_PLAYER ||
+                          dir == MM_BACKEND_DIRECTION_RECORDER, NULL);
+
+    g_mutex_lock (&devices_lock);
+    if (!device_names[dir])
+        device_names[dir] = g_ptr_array_new_with_free_func (g_free);
+    names = g_ptr_array_ref (device_names[dir]);
+    g_mutex_unlock (&devices_lock);
+
+    return names;
+}
+
+/**
+ * mm_backend_set_mute:
+ * @dir: %MM_BACKEND_DIRECTION_PLAYER for the speakers,
+ * %MM_BACKEND_DIRECTION_RECORDER for the microphone
+ * @mute: whether to silence it
+ *
+ * Silences the audio of every backend in the direction @dir from the
+ * next frame on. The pipelines keep running, so unmuting is
+ * immediate as well.
+ */
+void
+mm_backend_set_mute (MmBackendDirection dir, gboolean mute)
+{
+    g_return_if_fail (dir == MM_BACKEND_DIRECTION_PLAYER ||
+                      dir == MM_BACKEND_DIRECTION_RECORDER);
+
+    g_atomic_int_set (&audio_mute[dir], !!mute);
+}
+
+gboolean
+mm_backend_get_mute (MmBackendDirection dir)
+{
+    g_return_val_if_fail (dir == MM_BACKEND_DIRECTION_PLAYER ||
+                          dir == MM_BACKEND_DIRECTION_RECORDER, FALSE);
+
+    return g_atomic_int_get (&audio_mute[dir]);
+}
+
+/**
+ * mm_backend_set_gain:
+ * @dir: the direction to amplify
+ * @gain: the linear gain, 1.0 leaving the audio untouched
+ *
+ * Amplifies, saturating, the audio of every backend in the direction
+ * @dir from the next frame on. The gain ranges from 0 to about 8.
+ */
+void
+mm_backend_set_gain (MmBackendDirection dir, gdouble gain)
+{
+    g_return_if_fail (dir == MM_BACKEND_DIRECTION_PLAYER ||
+                      dir == MM_BACKEND_DIRECTION_RECORDER);
+
+    gain = CLAMP (gain * MM_AUDIO_GAIN_UNITY, 0, MM_AUDIO_GAIN_MAX);
+    g_atomic_int_set (&audio_gain[dir], (gint) (gain + 0.5));
+}
+
+gdouble
+mm_backend_get_gain (MmBackendDirection dir)
+{
+    g_return_val_if_fail (dir == MM_BACKEND_DIRECTION_PLAYER ||
+                          dir == MM_BACKEND_DIRECTION_RECORDER, 1.0);
+
+    return (gdouble) g_atomic_int_get (&audio_gain[dir]) / MM_AUDIO_GAIN_UNITY;
+}
+
+static inline gint
+get_gain (MmBackendDirection dir)
+{
+    if (g_atomic_int_get (&audio_mute[dir]))
+        return 0;
+
+    return g_atomic_int_get (&audio_gain[dir]);
+}
+
+/**
+ * mm_backend_set_voice_activity:
+ * @enable: whether to detect the voice activity
+ *
+ * Makes every recorder hand silence, all zeros, to Opal for the frames
+ * where nobody speaks, so the silence detection of Opal can stop
+ * sending them. It takes effect on the next frame.
+ */
+void
+mm_backend_set_voice_activity (gboolean enable)
+{
+    g_atomic_int_set (&vad_enabled, !!enable);
+}
+
+gboolean
+mm_backend_get_voice_activity (void)
+{
+    return g_atomic_int_get (&vad_enabled);
+}
+
+/**
+ * mm_backend_set_voice_activity_params:
+ * @threshold: the level of speech in dBFS, -45 by default
+ * @crossings: the rate of zero crossings, in crossings per sample,
+ * above which a frame up to 10 dB under @threshold is also speech;
+ * 0.25 by default
+ * @hangover: milliseconds still sent after the speech, 200 by default
+ *
+ * Tunes the voice activity detection.
+ */
+void
+mm_backend_set_voice_activity_params (gdouble threshold,
+                                      gdouble crossings,
+                                      guint hangover)
+{
+    gdouble energy;
+
+    energy = (1 << 28) * pow (10.0, MIN (threshold, 0.0) / 10.0);
+
+    g_atomic_int_set (&vad_energy, (gint) energy);
+    g_atomic_int_set (&vad_crossings, (gint) (CLAMP (crossings, 0.0, 1.0) * 1000));
+    g_atomic_int_set (&vad_hangover,
+                      (gint) (MIN (hangover, G_MAXINT / 1000) *
+                              G_TIME_SPAN_MILLISECOND));
+}
+
+/**
+ * mm_backend_set_capture_depth:
+ * @ms: milliseconds of captured audio to keep, or 0 to follow the
+ * buffers set by Opal
+ *
+ * Sets how much captured audio waits for Opal before the oldest is
+ * dropped. A deeper queue rides out longer stalls of the Opal media
+ * thread at the cost of latency. It takes effect on the next read;
+ * the recorders opened before keep their room for 500 ms at most.
+ */
+void
+mm_backend_set_capture_depth (guint ms)
+{
+    g_atomic_int_set (&capture_depth,
+                      (gint) (MIN (ms, G_MAXINT / 1000) *
+                              G_TIME_SPAN_MILLISECOND));
+}
+
+guint
+mm_backend_get_capture_depth (void)
+{
+    return g_atomic_int_get (&capture_depth) / G_TIME_SPAN_MILLISECOND;
+}
+
+/**
+ * mm_backend_set_duplex:
+ * @self: a #MmBackend instance
+ * @duplex: whether to run both directions in one pipeline
+ *
+ * In duplex mode, opening any direction brings up a single pipeline
+ * holding both the player and the recorder. They share the pipeline
+ * clock, and when the webrtcdsp plugin is available an in-process
+ * echo canceller sits on the capture branch, using the playback
+ * branch as its reference. The sound server is then not asked for
+ * its own canceller.
+ *
+ * It takes effect the next time the backend is opened.
+ */
+void
+mm_backend_set_duplex (MmBackend *self,
+                       gboolean duplex)
+{
+    g_return_if_fail (MM_IS_BACKEND (self));
+
+    self->priv->duplex = duplex;
+}
+
+/**
+ * mm_backend_set_conference:
+ * @self: a #MmBackend instance
+ * @conference: whether to open as a leg of the conference
+ *
+ * A leg has no pipelines of its own. What is written to it is mixed
+ * with the other legs into the player of the conference, and what is
+ * read from it is the capture plus the mix of the other legs. The
+ * first leg brings the conference up, on its device and in its format,
+ * always in duplex mode; the other legs must use the same format. The
+ * last one to close brings it down.
+ *
+ * It takes effect the next time the backend is opened.
+ */
+void
+mm_backend_set_conference (MmBackend *self,
+                           gboolean conference)
+{
+    g_return_if_fail (MM_IS_BACKEND (self));
+
+    self->priv->conference = conference;
+}
+
+/**
+ * mm_backend_set_buffers:
+ * @self: a #MmBackend instance
+ * @dir: the direction to configure
+ * @size: the size of each buffer in bytes
+ * @count: the number of buffers
+ *
+ * Bounds the queue of @dir to @count buffers of @size bytes. For the
+ * player, unless mm_backend_set_max_latency() was used, this is also
+ * the latency ceiling: beyond it the oldest queued audio is dropped.
+ *
+ * The configuration is kept for the next time @dir is opened.
+ */
+void
+mm_backend_set_buffers (MmBackend *self,
+                        MmBackendDirection dir,
+                        gsize size,
+                        guint count)
+{
+    g_return_if_fail (MM_IS_BACKEND (self));
+
+    if (dir != MM_BACKEND_DIRECTION_PLAYER &&
+        dir != MM_BACKEND_DIRECTION_RECORDER)
+        return;
+
+    GST_INFO ("direction %d: %u buffers of %" G_GSIZE_FORMAT " bytes",
+              dir, count, size);
+
+    self->priv->buffers[dir].size = size;
+    self->priv->buffers[dir].count = count;
+
+    apply_buffers (self, dir);
+}
+
+/**
+ * mm_backend_set_max_latency:
+ * @self: a #MmBackend instance
+ * @ms: the maximum playout delay in milliseconds, or 0 to derive it
+ * from the player buffers
+ *
+ * Sets the ceiling of the audio queued in the player. When it is
+ * reached the oldest audio is dropped, so the playout delay of a call
+ * stays bounded no matter how slow the sink runs.
+ */
+void
+mm_backend_set_max_latency (MmBackend *self,
+                            guint ms)
+{
+    g_return_if_fail (MM_IS_BACKEND (self));
+
+    self->priv->max_latency = ms * G_TIME_SPAN_MILLISECOND;
+    apply_buffers (self, MM_BACKEND_DIRECTION_PLAYER);
+}
+
+/* Opal closes a channel from another thread than the one reading or
+ * writing it. The close waits for the call in progress to leave. */
+static inline void
+leave_io (MmBackend *self, MmBackendDirection dir)
+{
+    MmBackendPrivate *priv = self->priv;
+
+    if (g_atomic_int_dec_and_test (&priv->busy[dir]) &&
+        g_atomic_int_get (&priv->closing[dir])) {
+        g_mutex_lock (&priv->lock);
+        g_cond_broadcast (&priv->cond);
+        g_mutex_unlock (&priv->lock);
+    }
+}
+
+static inline gboolean
+enter_io (MmBackend *self, MmBackendDirection dir)
+{
+    MmBackendPrivate *priv = self->priv;
+
+    g_atomic_int_inc (&priv->busy[dir]);
+    if (!g_atomic_int_get (&priv->closing[dir])) {
+        make_io_thread_realtime ();
+        return TRUE;
+    }
+
+    leave_io (self, dir);
+    return FALSE;
+}
+
+/* Parks the calling Opal thread while the call is on hold, until it
+ * is resumed or @dir closed. Returns whether it is still held. */
+static gboolean
+wait_while_held (MmBackend *self, MmBackendDirection dir)
+{
+    MmBackendPrivate *priv = self->priv;
+    gboolean held;
+
+    if (!g_atomic_int_get (&priv->held))
+        return FALSE;
+
+    g_mutex_lock (&priv->lock);
+    while ((held = g_atomic_int_get (&priv->held)) &&
+           !g_atomic_int_get (&priv->closing[dir]))
+        g_cond_wait (&priv->cond, &priv->lock);
+    g_mutex_unlock (&priv->lock);
+
+    return held;
+}
+
+/* the writer's count, published for the render probe */
+static inline void
+add_written (MmBackendPrivate *priv, gsize len)
+{
+    priv->written += len;
+    g_atomic_int_set (&priv->written_low, (gint) priv->written);
+}
+
+/* The buffers carry their byte offset in the stream written by Opal,
+ * so the level is what was written and the sink has not reached yet,
+ * whether it is still in the ring, appsrc or the queue. What the queue
+ * dropped is skipped over by the offsets. */
+static inline gint64
+player_level (MmBackend *self)
+{
+    MmBackendPrivate *priv = self->priv;
+    guint pending = (guint) priv->written - (guint) g_atomic_int_get (&priv->rendered);
+
+    return bytes_to_usecs (&priv->format[MM_BACKEND_DIRECTION_PLAYER], pending);
+}
+
+/* Blocks the writer for the time the sink takes to drain the player,
+ * holding @level microseconds, to the playout target. It never waits
+ * longer than the duration of the frame just written, so a stalled
+ * sink slows Opal down to real time at most. It takes no lock. */
+static void
+wait_for_playout (MmBackend *self, gint64 level, gsize len)
+{
+    MmBackendPrivate *priv = self->priv;
+    gint64 wait;
+
+    priv->stats.player_queue_level = level;
+
+    wait = MIN (priv->stats.player_queue_level - priv->playout_target,
+                bytes_to_usecs (&priv->format[MM_BACKEND_DIRECTION_PLAYER], len));
+    if (wait > 0)
+        g_usleep (wait);
+}
+
+/* (re)creates the player's buffer pool for frames of @size bytes. The
+ * pool preallocates all its buffers, so in steady state the player
+ * does not allocate at all. */
+static gboolean
+ensure_pool (MmBackend *self, gsize size)
+{
+    MmBackendPrivate *priv = self->priv;
+    GstStructure *config;
+
+    if (priv->pool && priv->pool_size == size)
+        return TRUE;
+
+    if (priv->pool) {
+        GST_INFO ("frame size changed %" G_GSIZE_FORMAT " -> %" G_GSIZE_FORMAT,
+                  priv->pool_size, size);
+        gst_buffer_pool_set_active (priv->pool, FALSE);
+        gst_object_unref (priv->pool);
+    }
+
+    priv->pool = gst_buffer_pool_new ();
+    priv->pool_size = 0;
+
+    config = gst_buffer_pool_get_config (priv->pool);
+    gst_buffer_pool_config_set_params (config, priv->caps, size,
+                                       POOL_BUFFERS, POOL_BUFFERS);
+
+    if (!gst_buffer_pool_set_config (priv->pool, config) ||
+        !gst_buffer_pool_set_active (priv->pool, TRUE)) {
+        GST_ERROR ("cannot activate the player buffer pool");
+        gst_object_unref (priv->pool);
+        priv->pool = NULL;
+        return FALSE;
+    }
+
+    priv->pool_size = size;
+    priv->stats.write_allocs += POOL_BUFFERS;
+
+    return TRUE;
+}
+
+static GstBuffer *
+acquire_buffer (MmBackend *self, gsize size)
+{
+    GstBufferPoolAcquireParams params = { 0, };
+    GstBuffer *buffer = NULL;
+
+    if (ensure_pool (self, size)) {
+        params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+        if (gst_buffer_pool_acquire_buffer (self->priv->pool, &buffer,
+                                            &params) == GST_FLOW_OK)
+            return buffer;
+    }
+
+    /* the pool is exhausted: the sink is not consuming */
+    GST_LOG ("buffer pool exhausted, allocating");
+    self->priv->stats.write_allocs++;
+
+    return gst_buffer_new_and_alloc (size);
+}
+
+/* Pushes to appsrc a frame of @len bytes, copied from @data or, if
+ * %NULL, read from the ring. */
+static gboolean
+push_player (MmBackend *self, const void *data, gsize len)
+{
+    MmBackendPrivate *priv = self->priv;
+    GstBuffer *buffer;
+    GstMapInfo map;
+
+    buffer = acquire_buffer (self, len);
+    if (!buffer)
+        return FALSE;
+
+    if (!gst_buffer_map (buffer, &map, GST_MAP_WRITE)) {
+        gst_buffer_unref (buffer);
+        return FALSE;
+    }
+
+    if (data)
+        memcpy (map.data, data, len);
+    else
+        mm_ring_read (priv->ring[MM_BACKEND_DIRECTION_PLAYER], map.data, len);
+    mm_audio_apply_gain ((gint16 *) map.data, len / 2,
+                         get_gain (MM_BACKEND_DIRECTION_PLAYER));
+    gst_buffer_unmap (buffer, &map);
+
+    GST_BUFFER_OFFSET (buffer) = priv->pushed;
+    priv->pushed += len;
+    GST_BUFFER_OFFSET_END (buffer) = priv->pushed;
+
+    g_atomic_int_set (&priv->push_ret,
+                      gst_app_src_push_buffer (priv->appsrc, buffer));
+
+    return TRUE;
+}
+
+/* Moves one Opal frame from the ring to appsrc. Only one thread at a
+ * time pumps: the appsrc streaming thread, from need-data, or the
+ * writer once the streaming thread found the ring empty. */
+static gboolean
+pump_player (MmBackend *self)
+{
+    MmRing *ring = self->priv->ring[MM_BACKEND_DIRECTION_PLAYER];
+    gsize len = g_atomic_int_get (&self->priv->frame_size);
+
+    if (len == 0 || mm_ring_available (ring) < len)
+        return FALSE;
+
+    return push_player (self, NULL, len);
+}
+
+static void
+need_data_cb (GstAppSrc *src, guint length, gpointer user_data)
+{
+    MmBackend *self = user_data;
+
+    /* appsrc now waits for a push, which the writer does next */
+    if (!pump_player (self))
+        g_atomic_int_set (&self->priv->starved, TRUE);
+}
+
+/* Joins @self to the conference, bringing it up on @dev if it is the
+ * first leg. Every leg runs in the format of the first one. */
+static gboolean
+conference_join (MmBackend *self, const char *dev, MmBackendDirection dir,
+                 guint channels, guint rate)
+{
+    MmBackendPrivate *priv = self->priv;
+    AudioFormat *format;
+    MmBackend *host = NULL, *spare = NULL;
+    gboolean running, ret = FALSE;
+    gsize samples;
+
+    g_mutex_lock (&conference_lock);
+    running = conference_host != NULL;
+    g_mutex_unlock (&conference_lock);
+
+    /* the media threads of a running conference take the lock: the
+     * device comes up without it */
+    if (!running) {
+        host = mm_backend_new ();
+        host->priv->host = TRUE;
+        mm_backend_set_duplex (host, TRUE);
+        if (!mm_backend_audio_open (host, dev, MM_BACKEND_DIRECTION_PLAYER,
+                                    channels, rate, 16)) {
+            g_object_unref (host);
+            return FALSE;
+        }
+    }
+
+    g_mutex_lock (&conference_lock);
+
+    if (host && conference_host) {
+        /* another leg brought the conference up meanwhile */
+        spare = host;
+    } else if (host) {
+        format = &host->priv->format[MM_BACKEND_DIRECTION_PLAYER];
+        conference_block = gst_util_uint64_scale (format->rate, CONFERENCE_BLOCK,
+                                                  G_USEC_PER_SEC) * format->bpf;
+        conference_mix = g_new (gint32, conference_block / 2);
+        conference_out = g_new (gint16, conference_block / 2);
+        conference_host = host;
+    } else if (!conference_host) {
+        /* and it went down since */
+        g_mutex_unlock (&conference_lock);
+        return conference_join (self, dev, dir, channels, rate);
+    }
+
+    format = &conference_host->priv->format[MM_BACKEND_DIRECTION_PLAYER];
+    if (format->rate != rate || format->bpf != channels * 2) {
+        GST_WARNING ("the conference runs at %u Hz, %u channels",
+                     format->rate, format->bpf / 2);
+        goto done;
+    }
+
+    samples = conference_block / 2;
+    priv->format[dir] = *format;
+    setup_ring (self, dir);
+
+    if (dir == MM_BACKEND_DIRECTION_PLAYER) {
+        g_free (priv->leg_block);
+        priv->leg_block = g_new0 (gint16, samples);
+    } else {
+        if (!priv->others ||
+            mm_ring_get_size (priv->others) < priv->capture_size) {
+            mm_ring_free (priv->others);
+            priv->others = mm_ring_new (priv->capture_size);
+        }
+        mm_ring_reset (priv->others);
+        g_free (priv->others_block);
+        priv->others_block = g_new (gint16, samples);
+        priv->others_size = conference_block;
+    }
+
+    /* the host pipelines are the ones that start */
+    priv->ready[dir] = TRUE;
+
+    if (!priv->leg[!dir])
+        conference_legs = g_list_prepend (conference_legs, self);
+    priv->leg[dir] = TRUE;
+    ret = TRUE;
+
+    GST_INFO ("direction %d joined the conference, %u legs", dir,
+              g_list_length (conference_legs));
+
+done:
+    g_mutex_unlock (&conference_lock);
+
+    if (spare) {
+        mm_backend_audio_close (spare);
+        g_object_unref (spare);
+    }
+
+    return ret;
+}
+
+/* the last leg to leave brings the conference down */
+static void
+conference_leave (MmBackend *self, MmBackendDirection dir)
+{
+    MmBackendPrivate *priv = self->priv;
+    MmBackend *host = NULL;
+
+    if (!priv->leg[dir])
+        return;
+
+    g_mutex_lock (&conference_lock);
+
+    priv->leg[dir] = FALSE;
+    if (!priv->leg[!dir])
+        conference_legs = g_list_remove (conference_legs, self);
+
+    if (!conference_legs) {
+        host = conference_host;
+        conference_host = NULL;
+        g_clear_pointer (&conference_mix, g_free);
+        g_clear_pointer (&conference_out, g_free);
+    }
+
+    g_mutex_unlock (&conference_lock);
+
+    /* release a reader waiting for the capture */
+    if (dir == MM_BACKEND_DIRECTION_RECORDER) {
+        g_mutex_lock (&priv->lock);
+        g_cond_broadcast (&priv->cond);
+        g_mutex_unlock (&priv->lock);
+    }
+
+    /* its streaming threads take the conference lock */
+    if (host) {
+        mm_backend_audio_close (host);
+        g_object_unref (host);
+    }
+}
+
+/* pushes a block of the mix to the player of the host */
+static void
+push_mixed (MmBackend *self, const gint16 *samples, gsize len)
+{
+    MmBackendPrivate *priv = self->priv;
+    GstBuffer *buffer;
+    GstMapInfo map;
+
+    if (!priv->player)
+        return;
+
+    buffer = acquire_buffer (self, len);
+    if (!buffer)
+        return;
+
+    if (!gst_buffer_map (buffer, &map, GST_MAP_WRITE)) {
+        gst_buffer_unref (buffer);
+        return;
+    }
+
+    memcpy (map.data, samples, len);
+    mm_audio_apply_gain ((gint16 *) map.data, len / 2,
+                         get_gain (MM_BACKEND_DIRECTION_PLAYER));
+    gst_buffer_unmap (buffer, &map);
+    priv->stats.write_copies++;
+
+    GST_BUFFER_OFFSET (buffer) = priv->written;
+    add_written (priv, len);
+    GST_BUFFER_OFFSET_END (buffer) = priv->written;
+
+    g_atomic_int_set (&priv->push_ret,
+                      gst_app_src_push_buffer (priv->appsrc, buffer));
+}
+
+/* Mixes the audio written by the legs, a block at a time, while all of
+ * them have a block, or one is three blocks ahead of a late one. Each
+ * recorder leg gets the mix without its own player. It runs in the
+ * writers, with the conference lock held, and allocates nothing. */
+static void
+conference_mix_blocks (void)
+{
+    gsize block = conference_block, samples = block / 2;
+    GList *l;
+
+    while (conference_host) {
+        gsize most = 0, least = G_MAXSIZE, n;
+
+        for (l = conference_legs; l; l = l->next) {
+            MmBackendPrivate *leg = MM_BACKEND (l->data)->priv;
+
+            if (!leg->leg[MM_BACKEND_DIRECTION_PLAYER])
+                continue;
+
+            n = mm_ring_available (leg->ring[MM_BACKEND_DIRECTION_PLAYER]);
+            most = MAX (most, n);
+            least = MIN (least, n);
+        }
+
+        if (most < block || (least < block && most < 3 * block))
+            return;
+
+        memset (conference_mix, 0, samples * sizeof (gint32));
+
+        for (l = conference_legs; l; l = l->next) {
+            MmBackendPrivate *leg = MM_BACKEND (l->data)->priv;
+
+            if (!leg->leg[MM_BACKEND_DIRECTION_PLAYER])
+                continue;
+
+            n = mm_ring_read (leg->ring[MM_BACKEND_DIRECTION_PLAYER],
+                              (guint8 *) leg->leg_block, block);
+            memset ((guint8 *) leg->leg_block + n, 0, block - n);
+            mm_audio_accumulate (conference_mix, leg->leg_block, samples);
+        }
+
+        for (l = conference_legs; l; l = l->next) {
+            MmBackendPrivate *leg = MM_BACKEND (l->data)->priv;
+
+            if (!leg->leg[MM_BACKEND_DIRECTION_RECORDER])
+                continue;
+
+            mm_audio_mix_minus (conference_out, conference_mix,
+                                leg->leg[MM_BACKEND_DIRECTION_PLAYER] ?
+                                leg->leg_block : NULL,
+                                samples);
+            mm_ring_write (leg->others, (guint8 *) conference_out, block);
+        }
+
+        mm_audio_mix_minus (conference_out, conference_mix, NULL, samples);
+        push_mixed (conference_host, conference_out, block);
+    }
+}
+
+static gboolean
+conference_write (MmBackend *self, const void *buf, gsize len)
+{
+    MmBackendPrivate *priv = self->priv;
+    MmRing *ring = priv->ring[MM_BACKEND_DIRECTION_PLAYER];
+    gint64 level = 0;
+
+    if (mm_ring_write (ring, buf, len))
+        priv->stats.write_copies++;
+    else
+        g_atomic_int_inc (&priv->write_dropped);
+
+    g_mutex_lock (&conference_lock);
+    conference_mix_blocks ();
+    if (conference_host)
+        level = player_level (conference_host);
+    g_mutex_unlock (&conference_lock);
+
+    /* what this leg still has to mix is queued too */
+    level += bytes_to_usecs (&priv->format[MM_BACKEND_DIRECTION_PLAYER],
+                             mm_ring_available (ring));
+
+    priv->stats.frames_written++;
+    wait_for_playout (self, level, len);
+
+    return TRUE;
+}
+
+static gboolean
+write_frame (MmBackend *self,
+             const void *buf,
+             size_t len,
+             size_t *written)
+{
+    MmBackendPrivate *priv = self->priv;
+    MmRing *ring = priv->ring[MM_BACKEND_DIRECTION_PLAYER];
+
+    GST_DEBUG ("write %ld", len);
+    GST_MEMDUMP ("write: ", buf, len);
+
+    /* nobody listens to a held call */
+    if (wait_while_held (self, MM_BACKEND_DIRECTION_PLAYER)) {
+        *written = len;
+        return TRUE;
+    }
+
+    if (priv->leg[MM_BACKEND_DIRECTION_PLAYER]) {
+        *written = len;
+        return conference_write (self, buf, len);
+    }
+
+    if (!priv->player || !ring)
+        return FALSE;
+
+    g_atomic_int_set (&priv->frame_size, len);
+
+    /* until PLAYING the sink only takes what it prerolls: beyond the
+     * playout target the early audio would only add latency */
+    if (!g_atomic_int_get (&priv->ready[MM_BACKEND_DIRECTION_PLAYER]) &&
+        player_level (self) >= priv->playout_target) {
+        GST_LOG ("player not ready, dropping %ld bytes", len);
+        priv->stats.write_early++;
+    } else if (mm_ring_available (ring) == 0 &&
+               g_atomic_int_compare_and_exchange (&priv->starved, TRUE, FALSE)) {
+        /* appsrc waits and nothing is queued before this frame: it goes
+         * straight into a pooled buffer, in one copy */
+        add_written (priv, len);
+        priv->stats.write_copies++;
+        push_player (self, buf, len);
+    } else if (mm_ring_write (ring, buf, len)) {
+        /* a full ring means the sink is stalled: drop the newest */
+        add_written (priv, len);
+        priv->stats.write_copies += 2;
+    } else {
+        g_atomic_int_inc (&priv->write_dropped);
+    }
+
+    if (g_atomic_int_compare_and_exchange (&priv->starved, TRUE, FALSE))
+        pump_player (self);
+
+    *written = len;
+
+    if (g_atomic_int_get (&priv->push_ret) != GST_FLOW_OK)
+        return FALSE;
+
+    priv->stats.frames_written++;
+
+    wait_for_playout (self, player_level (self), len);
+
+    return TRUE;
+}
+
+gboolean
+mm_backend_audio_write (MmBackend *self,
+                        const void *buf,
+                        size_t len,
+                        size_t *written)
+{
+    g_return_val_if_fail (MM_IS_BACKEND (self), FALSE);
+
+    gboolean ret;
+
+    if (!enter_io (self, MM_BACKEND_DIRECTION_PLAYER))
+        return FALSE;
+
+    ret = write_frame (self, buf, len, written);
+    leave_io (self, MM_BACKEND_DIRECTION_PLAYER);
+
+    return ret;
+}
+
+/* The converted capture goes into buffers of this pool, as big as
+ * the largest seen: a smaller one is trimmed, and the pool gives it
+ * back its size when released. Only the streaming thread uses it. */
+static GstBuffer *
+acquire_capture_buffer (MmBackend *self, gsize size)
+{
+    MmBackendPrivate *priv = self->priv;
+    GstStructure *config;
+    GstBuffer *buffer = NULL;
+
+    if (!priv->capture_pool || priv->capture_pool_size < size) {
+        if (priv->capture_pool) {
+            GST_INFO ("capture size grew %" G_GSIZE_FORMAT " -> %" G_GSIZE_FORMAT,
+                      priv->capture_pool_size, size);
+            gst_buffer_pool_set_active (priv->capture_pool, FALSE);
+            gst_object_unref (priv->capture_pool);
+        }
+
+        priv->capture_pool = gst_buffer_pool_new ();
+        priv->capture_pool_size = 0;
+
+        config = gst_buffer_pool_get_config (priv->capture_pool);
+        gst_buffer_pool_config_set_params (config, NULL, size,
+                                           CAPTURE_POOL_BUFFERS, 0);
+
+        if (!gst_buffer_pool_set_config (priv->capture_pool, config) ||
+            !gst_buffer_pool_set_active (priv->capture_pool, TRUE)) {
+            GST_ERROR ("cannot activate the capture buffer pool");
+            gst_object_unref (priv->capture_pool);
+            priv->capture_pool = NULL;
+            return NULL;
+        }
+
+        priv->capture_pool_size = size;
+    }
+
+    if (gst_buffer_pool_acquire_buffer (priv->capture_pool, &buffer,
+                                        NULL) != GST_FLOW_OK)
+        return NULL;
+
+    gst_buffer_resize (buffer, 0, size);
+
+    return buffer;
+}
+
+/* Returns the captured buffer in the call format. It is the very
+ * buffer when the device delivers that format, a converted one from
+ * the capture pool otherwise, or %NULL if the format is unknown. */
+static GstBuffer *
+convert_capture (MmBackend *self, GstSample *sample)
+{
+    MmBackendPrivate *priv = self->priv;
+    GstBuffer *buffer = gst_sample_get_buffer (sample), *out;
+    GstCaps *caps = gst_sample_get_caps (sample);
+    guint channels = priv->format[MM_BACKEND_DIRECTION_RECORDER].bpf / 2;
+    GstMapInfo in_map, out_map;
+    gsize frames, width;
+
+    if (caps && caps != priv->capture_caps) {
+        GstStructure *s = gst_caps_get_structure (caps, 0);
+        gint n = 0;
+
+        gst_structure_get_int (s, "channels", &n);
+        priv->capture_channels = n;
+        priv->capture_format =
+            mm_audio_format_from_string (gst_structure_get_string (s, "format"));
+        gst_caps_replace (&priv->capture_caps, caps);
+
+        GST_INFO ("capturing %" GST_PTR_FORMAT, caps);
+    }
+
+    if (priv->capture_format == MM_AUDIO_FORMAT_S16 &&
+        priv->capture_channels == channels)
+        return gst_buffer_ref (buffer);
+
+    width = mm_audio_format_width (priv->capture_format) * priv->capture_channels;
+    if (width == 0)
+        return NULL;
+
+    frames = gst_buffer_get_size (buffer) / width;
+    if (frames == 0)
+        return NULL;
+
+    out = acquire_capture_buffer (self, frames * channels * 2);
+    if (!out)
+        return NULL;
+
+    if (!gst_buffer_map (buffer, &in_map, GST_MAP_READ)) {
+        gst_buffer_unref (out);
+        return NULL;
+    }
+    if (!gst_buffer_map (out, &out_map, GST_MAP_WRITE)) {
+        gst_buffer_unmap (buffer, &in_map);
+        gst_buffer_unref (out);
+        return NULL;
+    }
+
+    mm_audio_convert ((gint16 *) out_map.data, channels,
+                      in_map.data, priv->capture_format, priv->capture_channels,
+                      frames);
+
+    gst_buffer_unmap (out, &out_map);
+    gst_buffer_unmap (buffer, &in_map);
+
+    gst_buffer_copy_into (out, buffer, GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+    g_atomic_int_inc (&priv->capture_copies);
+
+    return out;
+}
+
+/* counts @count frames of captured audio lost, and keeps when */
+static void
+record_capture_drop (MmBackend *self, guint count)
+{
+    MmBackendPrivate *priv = self->priv;
+    gint64 now = g_get_monotonic_time ();
+
+    g_atomic_int_add (&priv->capture_dropped, count);
+
+    g_mutex_lock (&priv->drop_lock);
+    priv->drop_times[priv->drop_next] = now;
+    priv->drop_next = (priv->drop_next + 1) % MM_BACKEND_DROP_HISTORY;
+    g_mutex_unlock (&priv->drop_lock);
+
+    GST_INFO ("capture lost %u frames at %" G_GINT64_FORMAT, count, now);
+}
+
+/* the capture timestamps are continuous unless the device lost
+ * buffers */
+static void
+check_capture_gap (MmBackend *self, GstBuffer *buffer)
+{
+    MmBackendPrivate *priv = self->priv;
+    GstClockTime pts = GST_BUFFER_PTS (buffer);
+    GstClockTime duration = GST_BUFFER_DURATION (buffer);
+
+    if (!GST_CLOCK_TIME_IS_VALID (pts))
+        return;
+
+    if (!GST_CLOCK_TIME_IS_VALID (duration)) {
+        duration = bytes_to_usecs (&priv->format[MM_BACKEND_DIRECTION_RECORDER],
+                                   gst_buffer_get_size (buffer)) * GST_USECOND;
+    }
+
+    if (GST_CLOCK_TIME_IS_VALID (priv->next_capture) && duration > 0 &&
+        pts > priv->next_capture + duration / 2) {
+        record_capture_drop (self,
+                             (pts - priv->next_capture + duration / 2) / duration);
+    }
+
+    priv->next_capture = pts + duration;
+}
+
+/* A frame is voiced if it is loud enough, or a bit quieter but with
+ * the many zero crossings of the unvoiced consonants. The frames that
+ * follow a voiced one are kept for the hangover time, so the ends of
+ * the words are not clipped. */
+static gboolean
+is_silent (MmBackend *self, const gint16 *samples, gsize count)
+{
+    MmBackendPrivate *priv = self->priv;
+    guint64 energy, threshold;
+    guint crossings;
+
+    energy = mm_audio_energy (samples, count, &crossings) / count;
+    threshold = g_atomic_int_get (&vad_energy);
+
+    if (energy > threshold ||
+        (energy * 10 > threshold &&
+         crossings * 1000 > count * g_atomic_int_get (&vad_crossings))) {
+        priv->vad_hangover = g_atomic_int_get (&vad_hangover);
+        return FALSE;
+    }
+
+    if (priv->vad_hangover > 0) {
+        priv->vad_hangover -=
+            bytes_to_usecs (&priv->format[MM_BACKEND_DIRECTION_RECORDER],
+                            count * 2);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static inline void
+wake_reader (MmBackend *self)
+{
+    MmBackendPrivate *priv = self->priv;
+
+    /* the lock is only taken when the reader is already waiting */
+    if (g_atomic_int_get (&priv->reader_waiting)) {
+        g_mutex_lock (&priv->lock);
+        g_cond_broadcast (&priv->cond);
+        g_mutex_unlock (&priv->lock);
+    }
+}
+
+/* hands the capture of the host to every recorder leg, which all
+ * share the buffer */
+static void
+conference_capture (GstBuffer *buffer)
+{
+    GList *l;
+
+    g_mutex_lock (&conference_lock);
+
+    for (l = conference_legs; l; l = l->next) {
+        MmBackend *leg = l->data;
+
+        if (!leg->priv->leg[MM_BACKEND_DIRECTION_RECORDER] ||
+            g_atomic_int_get (&leg->priv->held))
+            continue;
+
+        if (!capture_push (leg, buffer))
+            record_capture_drop (leg, 1);
+
+        wake_reader (leg);
+    }
+
+    g_mutex_unlock (&conference_lock);
+}
+
+/* runs in the streaming thread: it is the only producer of the
+ * capture ring */
+static GstFlowReturn
+new_sample_cb (GstAppSink *sink, gpointer user_data)
+{
+    MmBackend *self = user_data;
+    MmBackendPrivate *priv = self->priv;
+    GstSample *sample;
+    GstBuffer *buffer;
+
+    sample = gst_app_sink_pull_sample (sink);
+    if (!sample)
+        return GST_FLOW_OK;
+
+    if (g_atomic_int_compare_and_exchange (&priv->starting[MM_BACKEND_DIRECTION_RECORDER],
+                                           TRUE, FALSE))
+        set_started (self, MM_BACKEND_DIRECTION_RECORDER);
+
+    buffer = convert_capture (self, sample);
+    gst_sample_unref (sample);
+    if (!buffer)
+        return GST_FLOW_OK;
+
+    check_capture_gap (self, buffer);
+    check_deadline (self, MM_BACKEND_DIRECTION_RECORDER,
+                    GST_BUFFER_DURATION_IS_VALID (buffer) ?
+                    (gint64) GST_TIME_AS_USECONDS (GST_BUFFER_DURATION (buffer)) :
+                    bytes_to_usecs (&priv->format[MM_BACKEND_DIRECTION_RECORDER],
+                                    gst_buffer_get_size (buffer)),
+                    FALSE);
+
+    /* the reader copies straight out of the buffer; a full ring means
+     * Opal is not reading: drop the newest */
+    if (priv->host)
+        conference_capture (buffer);
+    else if (!capture_push (self, buffer))
+        record_capture_drop (self, 1);
+    gst_buffer_unref (buffer);
+
+    wake_reader (self);
+
+    return GST_FLOW_OK;
+}
+
+/* what the reader lets queue in the capture ring before dropping the
+ * oldest audio: the configured depth, the buffers set by Opal, or two
+ * frames */
+static gsize
+capture_bound (MmBackend *self, gsize len)
+{
+    MmBackendPrivate *priv = self->priv;
+    BufferConfig *config = &priv->buffers[MM_BACKEND_DIRECTION_RECORDER];
+    AudioFormat *format = &priv->format[MM_BACKEND_DIRECTION_RECORDER];
+    gint64 depth = g_atomic_int_get (&capture_depth);
+
+    if (depth > 0) {
+        gsize bytes = gst_util_uint64_scale (format->rate * format->bpf, depth,
+                                             G_USEC_PER_SEC);
+
+        return MAX (len, bytes - bytes % MAX (format->bpf, 1));
+    }
+
+    if (config->count > 0)
+        return MAX (len, config->size * config->count);
+
+    return 2 * len;
+}
+
+/* mixes into the frame of a recorder leg what the other legs of the
+ * conference said, once the microphone went through the gain and the
+ * voice activity detection */
+static void
+add_others (MmBackend *self, guint8 *buf, gsize len)
+{
+    MmBackendPrivate *priv = self->priv;
+    guint bpf = priv->format[MM_BACKEND_DIRECTION_RECORDER].bpf;
+    gsize available, excess, done = 0, n;
+
+    /* the mixer runs ahead by up to three blocks */
+    available = mm_ring_available (priv->others);
+    excess = available - MIN (available, len + 3 * priv->others_size);
+    mm_ring_skip (priv->others, excess - excess % bpf);
+
+    while (done < len) {
+        n = mm_ring_read (priv->others, (guint8 *) priv->others_block,
+                          MIN (len - done, priv->others_size));
+        if (n == 0)
+            break;
+
+        mm_audio_mix ((gint16 *) (buf + done), priv->others_block, n / 2);
+        done += n;
+    }
+}
+
+static gboolean
+read_frame (MmBackend *self,
+            void *buf,
+            size_t len,
+            size_t *read)
+{
+    MmBackendPrivate *priv = self->priv;
+    MmRing *ring = priv->ring[MM_BACKEND_DIRECTION_RECORDER];
+    guint bpf = priv->format[MM_BACKEND_DIRECTION_RECORDER].bpf;
+    gint64 deadline, start;
+    gsize available, excess;
+
+    if ((!priv->recorder && !priv->leg[MM_BACKEND_DIRECTION_RECORDER]) ||
+        !ring)
+        return FALSE;
+
+    if (len == 0) {
+        *read = 0;
+        return TRUE;
+    }
+
+    /* a held call sends silence */
+    if (wait_while_held (self, MM_BACKEND_DIRECTION_RECORDER)) {
+        memset (buf, 0, len);
+        *read = len;
+        return TRUE;
+    }
+
+    /* what was captured before the hold is stale by now */
+    if (g_atomic_int_compare_and_exchange (&priv->flush_capture, TRUE, FALSE))
+        capture_take (self, NULL, G_MAXSIZE);
+
+    /* a frame must be handed to Opal within its own duration,
+     * whatever the capture device is doing */
+    deadline = g_get_monotonic_time () +
+        bytes_to_usecs (&priv->format[MM_BACKEND_DIRECTION_RECORDER], len);
+
+    /* keep the capture latency bounded */
+    available = g_atomic_int_get (&priv->captured);
+    excess = available - MIN (available, capture_bound (self, len));
+    excess -= excess % bpf;
+    if (excess > 0) {
+        GST_LOG ("capture behind, dropping %ld bytes", excess);
+        capture_take (self, NULL, excess);
+        record_capture_drop (self, MAX (excess / len, 1));
+    }
+
+    GST_DEBUG ("to read %ld", len);
+    while ((gsize) g_atomic_int_get (&priv->captured) < len &&
+           g_get_monotonic_time () < deadline) {
+        /* slow path: the producer checks the flag after each write */
+        g_mutex_lock (&priv->lock);
+        g_atomic_int_set (&priv->reader_waiting, TRUE);
+        if ((gsize) g_atomic_int_get (&priv->captured) < len) {
+            start = g_get_monotonic_time ();
+            g_cond_wait_until (&priv->cond, &priv->lock, deadline);
+            priv->stats.read_blocked_time += g_get_monotonic_time () - start;
+        }
+        g_atomic_int_set (&priv->reader_waiting, FALSE);
+        g_mutex_unlock (&priv->lock);
+
+        if (g_atomic_int_get (&priv->closing[MM_BACKEND_DIRECTION_RECORDER]))
+            break;
+    }
+
+    *read = capture_take (self, buf, len);
+    GST_DEBUG ("read %ld", *read);
+
+    if (*read > 0)
+        priv->stats.read_copies++;
+
+    if (*read < len) {
+        GST_LOG ("capture late, filling %ld bytes with silence", len - *read);
+        memset ((guint8 *) buf + *read, 0, len - *read);
+        if (g_atomic_int_get (&priv->ready[MM_BACKEND_DIRECTION_RECORDER]))
+            priv->stats.read_late++;
+        else
+            priv->stats.read_early++;
+        priv->stats.read_filled_bytes += len - *read;
+        *read = len;
+    }
+
+    mm_audio_apply_gain (buf, len / 2, get_gain (MM_BACKEND_DIRECTION_RECORDER));
+
+    /* Opal's silence detector does not send the zeroed frames */
+    if (g_atomic_int_get (&vad_enabled) && len >= 2 &&
+        is_silent (self, buf, len / 2)) {
+        memset (buf, 0, len);
+        priv->stats.read_silent++;
+    }
+
+    if (priv->leg[MM_BACKEND_DIRECTION_RECORDER])
+        add_others (self, buf, len);
+
+    GST_MEMDUMP ("read: ", buf, *read);
+    priv->stats.frames_read++;
+
+    return TRUE;
+}
+
+gboolean
+mm_backend_audio_read (MmBackend *self,
+                       void *buf,
+                       size_t len,
+                       size_t *read)
+{
+    g_return_val_if_fail (MM_IS_BACKEND (self), FALSE);
+
+    gboolean ret;
+
+    if (!enter_io (self, MM_BACKEND_DIRECTION_RECORDER))
+        return FALSE;
+
+    ret = read_frame (self, buf, len, read);
+    leave_io (self, MM_BACKEND_DIRECTION_RECORDER);
+
+    return ret;
+}
+
+/**
+ * mm_backend_set_playout_target:
+ * @self: a #MmBackend instance
+ * @ms: the playout depth in milliseconds
+ *
+ * Sets how much audio, in milliseconds, is kept queued in the player.
+ * mm_backend_audio_write() blocks while more than this is queued.
+ */
+void
+mm_backend_set_playout_target (MmBackend *self,
+                               guint ms)
+{
+    g_return_if_fail (MM_IS_BACKEND (self));
+
+    self->priv->playout_target = ms * G_TIME_SPAN_MILLISECOND;
+}
+
+/**
+ * mm_backend_get_stats:
+ * @self: a #MmBackend instance
+ * @stats: (out caller-allocates): the counters snapshot
+ *
+ * Copies the current media path counters into @stats.
+ */
+void
+mm_backend_get_stats (MmBackend *self,
+                      MmBackendStats *stats)
+{
+    g_return_if_fail (MM_IS_BACKEND (self));
+    g_return_if_fail (stats != NULL);
+
+    MmBackendPrivate *priv = self->priv;
+    guint i;
+
+    g_mutex_lock (&priv->lock);
+    *stats = priv->stats;
+    g_mutex_unlock (&priv->lock);
+    stats->write_dropped = g_atomic_int_get (&priv->write_dropped);
+    stats->write_underruns = g_atomic_int_get (&priv->write_underruns);
+    stats->read_copies += g_atomic_int_get (&priv->capture_copies);
+    stats->read_dropped += g_atomic_int_get (&priv->capture_dropped);
+
+    /* the latest first */
+    g_mutex_lock (&priv->drop_lock);
+    for (i = 0; i < MM_BACKEND_DROP_HISTORY; i++) {
+        guint n = (priv->drop_next + MM_BACKEND_DROP_HISTORY - 1 - i) %
+            MM_BACKEND_DROP_HISTORY;
+        stats->read_drop_times[i] = priv->drop_times[n];
     }
+    g_mutex_unlock (&priv->drop_lock);
+    for (i = 0; i < MM_BACKEND_LATENCY_BUCKETS; i++)
+        stats->render_latency[i] = g_atomic_int_get (&priv->render_latency[i]);
+    stats->render_latency_max = g_atomic_int_get (&priv->render_latency_max);
+    stats->deadline_misses = g_atomic_int_get (&priv->deadline_misses);
+}
+
+/* keeps in @total the latest of both lists, the latest first */
+static void
+merge_drop_times (gint64 *total, const gint64 *times)
+{
+    gint64 merged[MM_BACKEND_DROP_HISTORY];
+    guint i, a = 0, b = 0;
 
-    return *read > 0;
+    for (i = 0; i < MM_BACKEND_DROP_HISTORY; i++)
+        merged[i] = total[a] >= times[b] ? total[a++] : times[b++];
+
+    memcpy (total, merged, sizeof (merged));
+}
+
+/* counters add up, the latencies and levels keep the worst */
+static void
+add_stats (MmBackendStats *total, const MmBackendStats *stats)
+{
+    guint i;
+
+    total->write_allocs += stats->write_allocs;
+    total->write_copies += stats->write_copies;
+    total->write_dropped += stats->write_dropped;
+    total->read_copies += stats->read_copies;
+    total->read_late += stats->read_late;
+    total->read_filled_bytes += stats->read_filled_bytes;
+    total->frames_written += stats->frames_written;
+    total->frames_read += stats->frames_read;
+    total->write_underruns += stats->write_underruns;
+    total->deadline_misses += stats->deadline_misses;
+    total->read_dropped += stats->read_dropped;
+    total->read_silent += stats->read_silent;
+    total->write_early += stats->write_early;
+    total->read_early += stats->read_early;
+    total->read_blocked_time += stats->read_blocked_time;
+    for (i = 0; i < MM_BACKEND_LATENCY_BUCKETS; i++)
+        total->render_latency[i] += stats->render_latency[i];
+    merge_drop_times (total->read_drop_times, stats->read_drop_times);
+
+    total->player_start_latency = MAX (total->player_start_latency,
+                                       stats->player_start_latency);
+    total->recorder_start_latency = MAX (total->recorder_start_latency,
+                                         stats->recorder_start_latency);
+    total->player_ready_latency = MAX (total->player_ready_latency,
+                                       stats->player_ready_latency);
+    total->recorder_ready_latency = MAX (total->recorder_ready_latency,
+                                         stats->recorder_ready_latency);
+    total->device_switch_gap = MAX (total->device_switch_gap,
+                                    stats->device_switch_gap);
+    total->player_device_latency = MAX (total->player_device_latency,
+                                        stats->player_device_latency);
+    total->recorder_device_latency = MAX (total->recorder_device_latency,
+                                          stats->recorder_device_latency);
+    total->player_queue_level = MAX (total->player_queue_level,
+                                     stats->player_queue_level);
+    total->render_latency_max = MAX (total->render_latency_max,
+                                     stats->render_latency_max);
+}
+
+/**
+ * mm_backend_get_global_stats:
+ * @stats: (out caller-allocates): the counters snapshot
+ *
+ * Copies into @stats the media path counters of the whole process:
+ * the counters of every backend ever created are added up, while the
+ * latencies and the queue level are the highest among them.
+ */
+void
+mm_backend_get_global_stats (MmBackendStats *stats)
+{
+    MmBackendStats backend_stats;
+    GList *l;
+
+    g_return_if_fail (stats != NULL);
+
+    g_mutex_lock (&stats_lock);
+    *stats = retired_stats;
+    for (l = backends; l; l = l->next) {
+        mm_backend_get_stats (l->data, &backend_stats);
+        add_stats (stats, &backend_stats);
+    }
+    g_mutex_unlock (&stats_lock);
 }
@@ -48,6 +48,126 @@ typedef enum {
     MM_BACKEND_DIRECTION_PLAYER
 } MmBackendDirection;
 
+/**
+ * MmBackendIdlePolicy:
+ * @MM_BACKEND_IDLE_TEARDOWN: shut the pipelines down
+ * @MM_BACKEND_IDLE_READY: keep them built, with the devices closed
+ * @MM_BACKEND_IDLE_WARM: keep them prerolled, with the devices open
+ *
+ * What becomes of the pipelines of a call once it is closed.
+ */
+typedef enum {
+    MM_BACKEND_IDLE_TEARDOWN,
+    MM_BACKEND_IDLE_READY,
+    MM_BACKEND_IDLE_WARM
+} MmBackendIdlePolicy;
+
+/**
+ * MmBackendRealtime:
+ * @MM_BACKEND_REALTIME_NONE: leave the threads as they are created
+ * @MM_BACKEND_REALTIME_NICE: raise their niceness
+ * @MM_BACKEND_REALTIME_RR: run them in SCHED_RR
+ * @MM_BACKEND_REALTIME_FIFO: run them in SCHED_FIFO
+ *
+ * How the streaming threads, and the Opal threads moving the audio,
+ * are scheduled.
+ */
+typedef enum {
+    MM_BACKEND_REALTIME_NONE,
+    MM_BACKEND_REALTIME_NICE,
+    MM_BACKEND_REALTIME_RR,
+    MM_BACKEND_REALTIME_FIFO
+} MmBackendRealtime;
+
+typedef struct _MmBackendStats MmBackendStats;
+
+/* buckets of the write-to-render latency histogram */
+#define MM_BACKEND_LATENCY_BUCKETS 9
+
+/* capture losses whose time is kept */
+#define MM_BACKEND_DROP_HISTORY 8
+
+/**
+ * MmBackendStats:
+ * @write_allocs: buffers allocated for the player, including the pool
+ * preallocation
+ * @write_copies: payload copies done by the player: into and out of
+ * its ring, or once when a frame goes straight to a waiting appsrc
+ * @write_dropped: times the player dropped audio, its oldest to stay
+ * under the latency ceiling or its newest when the ring was full
+ * @read_copies: payload copies done by the recorder: the conversions
+ * to the call format, and the copy out of the captured buffers into
+ * the frame of Opal
+ * @read_late: frames not captured in time and completed with silence
+ * @read_filled_bytes: bytes of silence handed to Opal
+ * @player_start_latency: microseconds from the open to the first
+ * buffer reaching the audio sink
+ * @recorder_start_latency: microseconds from the open to the first
+ * captured sample
+ * @player_device_latency: microseconds of buffering reported by the
+ * audio sink once negotiated
+ * @recorder_device_latency: microseconds of buffering reported by the
+ * audio source once negotiated
+ * @frames_written: frames handed to the player
+ * @frames_read: frames handed to Opal by the recorder
+ * @write_underruns: times the player queue ran dry
+ * @read_dropped: captured frames lost before Opal could read them:
+ * lost by the device, or dropped by the recorder when its queue was
+ * full
+ * @read_silent: frames the voice activity detection silenced
+ * @read_blocked_time: microseconds the recorder waited for captured
+ * audio
+ * @player_queue_level: microseconds of audio queued in the player at
+ * the last write
+ * @render_latency: histogram of the time from the write to the audio
+ * sink; bucket i counts the latencies under 2^i milliseconds, the
+ * last one all the others
+ * @render_latency_max: the highest of those latencies, in microseconds
+ * @read_drop_times: monotonic times, in microseconds, of the latest
+ * captured audio losses, the latest first; 0 for the unused ones
+ * @write_early: frames dropped by the player before it was PLAYING
+ * @read_early: frames handed to Opal as silence before the recorder
+ * was PLAYING
+ * @player_ready_latency: microseconds from the open to the PLAYING
+ * state of the player
+ * @recorder_ready_latency: microseconds from the open to the PLAYING
+ * state of the recorder
+ * @device_switch_gap: microseconds the audio was held up by the last
+ * device switch
+ * @deadline_misses: buffers a streaming thread handed over a whole
+ * buffer late, while it had audio to move
+ *
+ * Snapshot of the media path counters.
+ */
+struct _MmBackendStats {
+    guint64 write_allocs;
+    guint64 write_copies;
+    guint64 write_dropped;
+    guint64 read_copies;
+    guint64 read_late;
+    guint64 read_filled_bytes;
+    gint64 player_start_latency;
+    gint64 recorder_start_latency;
+    gint64 player_device_latency;
+    gint64 recorder_device_latency;
+    guint64 frames_written;
+    guint64 frames_read;
+    guint64 write_underruns;
+    guint64 read_dropped;
+    guint64 read_silent;
+    gint64 read_blocked_time;
+    gint64 player_queue_level;
+    guint64 render_latency[MM_BACKEND_LATENCY_BUCKETS];
+    gint64 render_latency_max;
+    gint64 read_drop_times[MM_BACKEND_DROP_HISTORY];
+    guint64 write_early;
+    guint64 read_early;
+    gint64 player_ready_latency;
+    gint64 recorder_ready_latency;
+    gint64 device_switch_gap;
+    guint64 deadline_misses;
+};
+
 GType
 mm_backend_get_type                             (void) G_GNUC_CONST;
 
@@ -62,18 +182,123 @@ mm_backend_audio_open                           (MmBackend *self,
                                                  const char *dev,
                                                  MmBackendDirection dir,
                                                  guint channels,
-                                                 guint rate);
+                                                 guint rate,
+                                                 guint bits);
 
 gboolean
 mm_backend_audio_is_open                        (MmBackend *self);
 
+gboolean
+mm_backend_audio_is_direction_open              (MmBackend *self,
+                                                 MmBackendDirection dir);
+
 gboolean
 mm_backend_audio_close                          (MmBackend *self);
 
+gboolean
+mm_backend_audio_close_direction                (MmBackend *self,
+                                                 MmBackendDirection dir);
+
+void
+mm_backend_prewarm                              (gboolean duplex);
+
+void
+mm_backend_clear_cache                          (void);
+
+void
+mm_backend_set_idle_policy                      (MmBackendIdlePolicy policy);
+
+MmBackendIdlePolicy
+mm_backend_get_idle_policy                      (void);
+
+void
+mm_backend_set_realtime                         (MmBackendRealtime policy,
+                                                 gint priority);
+
+MmBackendRealtime
+mm_backend_get_realtime                         (gint *priority);
+
+gboolean
+mm_backend_set_cpu_affinity                     (const gchar *cpus);
+
+gboolean
+mm_backend_set_audio_element                    (MmBackendDirection dir,
+                                                 const gchar *description);
+
+void
+mm_backend_set_audio_timing                     (MmBackendDirection dir,
+                                                 gint64 latency_time,
+                                                 gint64 buffer_time);
+
+gint64
+mm_backend_get_device_latency                   (MmBackendDirection dir);
+
+void
+mm_backend_monitor_devices                      (void);
+
+GPtrArray *
+mm_backend_get_devices                          (MmBackendDirection dir);
+
+void
+mm_backend_set_mute                             (MmBackendDirection dir,
+                                                 gboolean mute);
+
+gboolean
+mm_backend_get_mute                             (MmBackendDirection dir);
+
 void
-mm_backend_set_buffer_size                      (MmBackend *self,
+mm_backend_set_gain                             (MmBackendDirection dir,
+                                                 gdouble gain);
+
+gdouble
+mm_backend_get_gain                             (MmBackendDirection dir);
+
+void
+mm_backend_set_voice_activity                   (gboolean enable);
+
+gboolean
+mm_backend_get_voice_activity                   (void);
+
+void
+mm_backend_set_voice_activity_params            (gdouble threshold,
+                                                 gdouble crossings,
+                                                 guint hangover);
+
+void
+mm_backend_set_capture_depth                    (guint ms);
+
+guint
+mm_backend_get_capture_depth                    (void);
+
+void
+mm_backend_set_duplex                           (MmBackend *self,
+                                                 gboolean duplex);
+
+void
+mm_backend_set_conference                       (MmBackend *self,
+                                                 gboolean conference);
+
+gboolean
+mm_backend_switch_device                        (MmBackend *self,
+                                                 MmBackendDirection dir,
+                                                 const char *device);
+
+void
+mm_backend_set_hold                             (MmBackend *self,
+                                                 gboolean hold);
+
+gboolean
+mm_backend_get_hold                             (MmBackend *self);
+
+void
+mm_backend_set_buffers                          (MmBackend *self,
                                                  MmBackendDirection dir,
-                                                 size_t size);
+                                                 gsize size,
+                                                 guint count);
+
+void
+mm_backend_set_max_latency                      (MmBackend *self,
+                                                 guint ms);
 
 gboolean
 mm_backend_audio_write                          (MmBackend *self,
@@ -87,6 +312,17 @@ mm_backend_audio_read                           (MmBackend *self,
                                                  size_t len,
                                                  size_t *read);
 
+void
+mm_backend_set_playout_target                   (MmBackend *self,
+                                                 guint ms);
+
+void
+mm_backend_get_stats                            (MmBackend *self,
+                                                 MmBackendStats *stats);
+
+void
+mm_backend_get_global_stats                     (MmBackendStats *stats);
+
 G_END_DECLS
 
 #endif /* MM_BACKEND_H */
@@ -0,0 +1,814 @@
+/*
+ * Copyright (C) 2026 Igalia S.L.
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+/*
+ * Drives MmBackend the way the Opal media threads do, one thread per
+ * direction writing or reading a frame at a time, on the synthetic
+ * devices, so it needs no sound hardware. With --micro it times the
+ * sample kernels, the conference mixer and the rings instead.
+ */
+
+#include "mmbackend.h"
+#include "mmaudio.h"
+#include "mmring.h"
+
+#include <gst/gst.h>
+#include <gst/base/gstadapter.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+static gint rate = 8000;
+static gint channels = 1;
+static gint frame_ms = 20;
+static gint seconds = 5;
+static gint buffers = 2;
+static gint playout_target = 0;
+static gchar *device = NULL;
+static gboolean duplex = FALSE;
+static gboolean player_only = FALSE;
+static gboolean recorder_only = FALSE;
+static gboolean micro = FALSE;
+static gint hold = 0;
+static gint idle = 0;
+static gchar *idle_policy = NULL;
+static gchar *source_element = NULL;
+static gchar *sink_element = NULL;
+static gchar *realtime = NULL;
+static gint priority = 0;
+static gchar *cpus = NULL;
+static gint load = 0;
+
+static GOptionEntry entries[] = {
+    { "rate", 'r', 0, G_OPTION_ARG_INT, &rate,
+      "Sample rate of the call (8000)", "HZ" },
+    { "channels", 'c', 0, G_OPTION_ARG_INT, &channels,
+      "Channels of the call, 1 or 2 (1)", "N" },
+    { "frame", 'f', 0, G_OPTION_ARG_INT, &frame_ms,
+      "Duration of each frame (20)", "MS" },
+    { "seconds", 's', 0, G_OPTION_ARG_INT, &seconds,
+      "Duration of the run (5)", "S" },
+    { "buffers", 'b', 0, G_OPTION_ARG_INT, &buffers,
+      "Buffers set as Opal does (2)", "N" },
+    { "playout-target", 't', 0, G_OPTION_ARG_INT, &playout_target,
+      "Audio kept queued in the player, 0 for the default", "MS" },
+    { "device", 'd', 0, G_OPTION_ARG_STRING, &device,
+      "Sound device (Gst:test)", "NAME" },
+    { "duplex", 'x', 0, G_OPTION_ARG_NONE, &duplex,
+      "Run both directions in one pipeline", NULL },
+    { "player", 'p', 0, G_OPTION_ARG_NONE, &player_only,
+      "Only run the player", NULL },
+    { "recorder", 'R', 0, G_OPTION_ARG_NONE, &recorder_only,
+      "Only run the recorder", NULL },
+    { "hold", 'H', 0, G_OPTION_ARG_INT, &hold,
+      "Compare the CPU of the call active and on hold, S seconds each", "S" },
+    { "idle", 'i', 0, G_OPTION_ARG_INT, &idle,
+      "Count the wakeups of the idle phone for S seconds after the run", "S" },
+    { "idle-policy", 'I', 0, G_OPTION_ARG_STRING, &idle_policy,
+      "Pipelines between calls: teardown, ready or warm (warm)", "POLICY" },
+    { "source", 0, 0, G_OPTION_ARG_STRING, &source_element,
+      "Capture element of the Gst device", "DESCRIPTION" },
+    { "sink", 0, 0, G_OPTION_ARG_STRING, &sink_element,
+      "Playback element of the Gst device", "DESCRIPTION" },
+    { "realtime", 'T', 0, G_OPTION_ARG_STRING, &realtime,
+      "Audio threads scheduling: none, nice, rr or fifo (none)", "POLICY" },
+    { "priority", 'P', 0, G_OPTION_ARG_INT, &priority,
+      "Real-time priority, or niceness (10, or -15 for nice)", "N" },
+    { "cpus", 'C', 0, G_OPTION_ARG_STRING, &cpus,
+      "CPUs the audio threads are pinned to", "LIST" },
+    { "load", 'l', 0, G_OPTION_ARG_INT, &load,
+      "Processes spinning on the CPUs during the run", "N" },
+    { "micro", 'm', 0, G_OPTION_ARG_NONE, &micro,
+      "Time the sample kernels, the mixer and the rings", NULL },
+    { NULL }
+};
+
+/* every allocation of the process, the streaming threads included:
+ * the aligned ones all go through __libc_memalign */
+static gint allocs;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t count, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void *__libc_memalign (size_t alignment, size_t size);
+
+void *
+malloc (size_t size)
+{
+    g_atomic_int_inc (&allocs);
+    return __libc_malloc (size);
+}
+
+void *
+calloc (size_t count, size_t size)
+{
+    g_atomic_int_inc (&allocs);
+    return __libc_calloc (count, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+    g_atomic_int_inc (&allocs);
+    return __libc_realloc (ptr, size);
+}
+
+void *
+memalign (size_t alignment, size_t size)
+{
+    g_atomic_int_inc (&allocs);
+    return __libc_memalign (alignment, size);
+}
+
+void *
+aligned_alloc (size_t alignment, size_t size)
+{
+    g_atomic_int_inc (&allocs);
+    return __libc_memalign (alignment, size);
+}
+
+int
+posix_memalign (void **ptr, size_t alignment, size_t size)
+{
+    void *mem;
+
+    if (alignment % sizeof (void *) != 0 ||
+        (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+
+    g_atomic_int_inc (&allocs);
+    mem = __libc_memalign (alignment, size);
+    if (!mem && size)
+        return ENOMEM;
+
+    *ptr = mem;
+    return 0;
+}
+
+#define HAVE_ALLOC_COUNT 1
+#endif
+
+static inline gint64
+now_ns (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (gint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* process CPU time, all the threads */
+static gint64
+cpu_ns (void)
+{
+    struct rusage usage;
+
+    getrusage (RUSAGE_SELF, &usage);
+    return ((gint64) usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000 +
+        ((gint64) usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000;
+}
+
+static int
+compare_times (const void *a, const void *b)
+{
+    gint64 x = *(const gint64 *) a, y = *(const gint64 *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+static gint64
+percentile (gint64 *sorted, guint count, guint p)
+{
+    if (count == 0)
+        return 0;
+
+    return sorted[MIN (count - 1, (guint64) count * p / 100)];
+}
+
+/* the upper bound, in milliseconds, of the histogram bucket holding
+ * the percentile @p, or -1 if it is the open one */
+static gint
+histogram_percentile (const guint64 *histogram, guint p)
+{
+    guint64 total = 0, seen = 0;
+    guint i;
+
+    for (i = 0; i < MM_BACKEND_LATENCY_BUCKETS; i++)
+        total += histogram[i];
+
+    for (i = 0; i < MM_BACKEND_LATENCY_BUCKETS - 1; i++) {
+        seen += histogram[i];
+        if (total > 0 && seen * 100 >= total * p)
+            return 1 << i;
+    }
+
+    return -1;
+}
+
+typedef struct {
+    MmBackend *backend;
+    MmBackendDirection dir;
+    gsize frame_size;
+    guint frames;
+    guint done;
+    gint64 *times;  /* nanoseconds in each call */
+    GThread *thread;
+} Run;
+
+static GMutex ready_lock;
+static GCond ready_cond;
+static gint ready_count;
+
+static void
+media_ready_cb (MmBackend *backend, gint dir, gint64 latency, gpointer data)
+{
+    g_mutex_lock (&ready_lock);
+    ready_count++;
+    g_cond_broadcast (&ready_cond);
+    g_mutex_unlock (&ready_lock);
+}
+
+static gpointer
+run_direction (gpointer data)
+{
+    Run *run = data;
+    guint8 *frame = g_malloc0 (run->frame_size);
+    gint16 *samples = (gint16 *) frame;
+    gsize i, count = run->frame_size / 2;
+    gboolean ok;
+
+    /* something for the gain and the voice activity to chew on */
+    for (i = 0; i < count; i++)
+        samples[i] = (i & 16) ? 3000 : -3000;
+
+    for (run->done = 0; run->done < run->frames; run->done++) {
+        gint64 start = now_ns ();
+        size_t n;
+
+        if (run->dir == MM_BACKEND_DIRECTION_PLAYER)
+            ok = mm_backend_audio_write (run->backend, frame, run->frame_size, &n);
+        else
+            ok = mm_backend_audio_read (run->backend, frame, run->frame_size, &n);
+
+        run->times[run->done] = now_ns () - start;
+        if (!ok)
+            break;
+    }
+
+    g_free (frame);
+
+    return NULL;
+}
+
+static gboolean
+open_direction (Run *run, MmBackend *backend, MmBackendDirection dir,
+                gsize frame_size, guint frames)
+{
+    run->backend = backend;
+    run->dir = dir;
+    run->frame_size = frame_size;
+    run->frames = frames;
+    run->times = g_new0 (gint64, frames);
+
+    mm_backend_set_buffers (backend, dir, frame_size, buffers);
+    if (dir == MM_BACKEND_DIRECTION_PLAYER && playout_target > 0)
+        mm_backend_set_playout_target (backend, playout_target);
+
+    return mm_backend_audio_open (backend, device, dir, channels, rate, 16);
+}
+
+static void
+report_direction (Run *run)
+{
+    MmBackendStats stats;
+    const gchar *name;
+    gint p50, p99;
+
+    name = run->dir == MM_BACKEND_DIRECTION_PLAYER ? "player" : "recorder";
+    qsort (run->times, run->done, sizeof (gint64), compare_times);
+    mm_backend_get_stats (run->backend, &stats);
+
+    printf ("%s: %u of %u frames of %" G_GSIZE_FORMAT " bytes\n",
+            name, run->done, run->frames, run->frame_size);
+    printf ("  call       p50 %" G_GINT64_FORMAT " us, p99 %" G_GINT64_FORMAT
+            " us, max %" G_GINT64_FORMAT " us\n",
+            percentile (run->times, run->done, 50) / 1000,
+            percentile (run->times, run->done, 99) / 1000,
+            run->done ? run->times[run->done - 1] / 1000 : 0);
+
+    if (run->dir == MM_BACKEND_DIRECTION_PLAYER) {
+        p50 = histogram_percentile (stats.render_latency, 50);
+        p99 = histogram_percentile (stats.render_latency, 99);
+        printf ("  render     p50 %s%d ms, p99 %s%d ms, max %" G_GINT64_FORMAT
+                " us\n",
+                p50 < 0 ? ">= " : "< ", p50 < 0 ? 1 << (MM_BACKEND_LATENCY_BUCKETS - 2) : p50,
+                p99 < 0 ? ">= " : "< ", p99 < 0 ? 1 << (MM_BACKEND_LATENCY_BUCKETS - 2) : p99,
+                stats.render_latency_max);
+        printf ("  drops      %" G_GUINT64_FORMAT " dropped, %" G_GUINT64_FORMAT
+                " underruns, %" G_GUINT64_FORMAT " early\n",
+                stats.write_dropped, stats.write_underruns, stats.write_early);
+        printf ("  copies     %.2f/frame, %" G_GUINT64_FORMAT " buffers allocated\n",
+                run->done ? (gdouble) stats.write_copies / run->done : 0.0,
+                stats.write_allocs);
+        printf ("  ready      %" G_GINT64_FORMAT " us\n",
+                stats.player_ready_latency);
+        printf ("  deadlines  %" G_GUINT64_FORMAT " missed\n",
+                stats.deadline_misses);
+    } else {
+        printf ("  drops      %" G_GUINT64_FORMAT " dropped, %" G_GUINT64_FORMAT
+                " late, %" G_GUINT64_FORMAT " early\n",
+                stats.read_dropped, stats.read_late, stats.read_early);
+        printf ("  copies     %.2f/frame, %" G_GINT64_FORMAT " us blocked\n",
+                run->done ? (gdouble) stats.read_copies / run->done : 0.0,
+                stats.read_blocked_time);
+        printf ("  ready      %" G_GINT64_FORMAT " us\n",
+                stats.recorder_ready_latency);
+        printf ("  deadlines  %" G_GUINT64_FORMAT " missed\n",
+                stats.deadline_misses);
+    }
+}
+
+/* Compares the CPU the process takes per second while the call is
+ * active and while it is on hold, then resumes it. Returns the CPU
+ * and the frames that went by on hold. */
+static gint64
+measure_hold (MmBackend **backends, Run *runs, guint *held_frames)
+{
+    gint64 active, held, resume;
+    guint i, before = 0, after = 0;
+
+    active = cpu_ns ();
+    g_usleep (hold * G_USEC_PER_SEC);
+    active = cpu_ns () - active;
+
+    for (i = 0; i < 2; i++) {
+        if (backends[i])
+            mm_backend_set_hold (backends[i], TRUE);
+        before += runs[i].done;
+    }
+
+    held = cpu_ns ();
+    g_usleep (hold * G_USEC_PER_SEC);
+    held = cpu_ns () - held;
+
+    resume = now_ns ();
+    for (i = 0; i < 2; i++) {
+        if (backends[i])
+            mm_backend_set_hold (backends[i], FALSE);
+        after += runs[i].done;
+    }
+    resume = now_ns () - resume;
+
+    *held_frames = after - before;
+
+    printf ("hold:       %" G_GINT64_FORMAT " us/s active, %" G_GINT64_FORMAT
+            " us/s held, %" G_GINT64_FORMAT " us/s saved, resumed in %"
+            G_GINT64_FORMAT " us\n",
+            active / hold / 1000, held / hold / 1000,
+            (active - held) / hold / 1000, resume / 1000);
+
+    return held;
+}
+
+/* What the process does once the call is closed: the voluntary
+ * context switches are the times one of its threads went to sleep,
+ * so woke up, and the CPU is what the kept pipelines cost. */
+static void
+measure_idle (void)
+{
+    struct rusage before, after;
+    gint64 cpu;
+    glong wakeups;
+
+    getrusage (RUSAGE_SELF, &before);
+    cpu = cpu_ns ();
+    g_usleep (idle * G_USEC_PER_SEC);
+    cpu = cpu_ns () - cpu;
+    getrusage (RUSAGE_SELF, &after);
+
+    /* less the sleep of this thread */
+    wakeups = after.ru_nvcsw - before.ru_nvcsw - 1;
+
+    printf ("idle:       %.1f wakeups/s, %" G_GINT64_FORMAT " us/s cpu, %s\n",
+            (gdouble) MAX (wakeups, 0) / idle, cpu / idle / 1000,
+            idle_policy ? idle_policy : "warm");
+}
+
+/* Other processes, so their CPU is not counted, competing with the
+ * audio threads as a build would. Returns their pids, 0 terminated. */
+static pid_t *
+start_load (void)
+{
+    pid_t *pids = g_new0 (pid_t, MAX (load, 0) + 1);
+    gint i, n = 0;
+
+    for (i = 0; i < load; i++) {
+        pid_t pid = fork ();
+
+        if (pid == 0) {
+            volatile guint64 spin = 0;
+
+            for (;;)
+                spin++;
+        }
+        if (pid > 0)
+            pids[n++] = pid;
+    }
+
+    return pids;
+}
+
+static void
+stop_load (pid_t *pids)
+{
+    pid_t *pid;
+
+    for (pid = pids; *pid; pid++) {
+        kill (*pid, SIGKILL);
+        waitpid (*pid, NULL, 0);
+    }
+    g_free (pids);
+}
+
+static int
+run_backend (void)
+{
+    MmBackend *backends[2] = { NULL, NULL };
+    Run runs[2];
+    gboolean enabled[2];
+    gsize frame_size;
+    guint frames, i, expected = 0, total = 0;
+    gint64 cpu, end_time, held_cpu = 0;
+    guint held_frames = 0;
+    gint alloc_count;
+    pid_t *load_pids;
+
+    memset (runs, 0, sizeof (runs));
+    frame_size = (gsize) rate * frame_ms / 1000 * channels * 2;
+    /* the call must still be running once the hold is measured */
+    frames = MAX (seconds, hold + 1) * 1000 / frame_ms;
+
+    enabled[MM_BACKEND_DIRECTION_PLAYER] = !recorder_only;
+    enabled[MM_BACKEND_DIRECTION_RECORDER] = !player_only;
+
+    for (i = 0; i < 2; i++) {
+        if (!enabled[i])
+            continue;
+
+        if (duplex && i == MM_BACKEND_DIRECTION_PLAYER &&
+            backends[MM_BACKEND_DIRECTION_RECORDER]) {
+            backends[i] = g_object_ref (backends[MM_BACKEND_DIRECTION_RECORDER]);
+        } else {
+            backends[i] = mm_backend_new ();
+            mm_backend_set_duplex (backends[i], duplex);
+            g_signal_connect (backends[i], "media-ready",
+                              G_CALLBACK (media_ready_cb), NULL);
+        }
+
+        if (!open_direction (&runs[i], backends[i], i, frame_size, frames)) {
+            g_printerr ("cannot open the %s on %s\n",
+                        i == MM_BACKEND_DIRECTION_PLAYER ? "player" : "recorder",
+                        device);
+            return 1;
+        }
+        expected++;
+    }
+
+    /* the start is measured apart, as the ready latency */
+    if (duplex)
+        expected = 2;
+    end_time = g_get_monotonic_time () + 5 * G_TIME_SPAN_SECOND;
+    g_mutex_lock (&ready_lock);
+    while (ready_count < (gint) expected) {
+        if (!g_cond_wait_until (&ready_cond, &ready_lock, end_time))
+            break;
+    }
+    g_mutex_unlock (&ready_lock);
+
+    printf ("%s, %d Hz, %d channels, %d ms frames, %d buffers%s\n",
+            device, rate, channels, frame_ms, buffers,
+            duplex ? ", duplex" : "");
+    if (realtime || cpus || load > 0) {
+        printf ("%s scheduling, %s, %d loading processes\n",
+                realtime ? realtime : "none", cpus ? cpus : "any CPU", load);
+    }
+
+    load_pids = start_load ();
+    alloc_count = g_atomic_int_get (&allocs);
+    cpu = cpu_ns ();
+
+    for (i = 0; i < 2; i++) {
+        if (enabled[i])
+            runs[i].thread = g_thread_new ("bench", run_direction, &runs[i]);
+    }
+
+    if (hold > 0)
+        held_cpu = measure_hold (backends, runs, &held_frames);
+
+    for (i = 0; i < 2; i++) {
+        if (!enabled[i])
+            continue;
+        g_thread_join (runs[i].thread);
+        total += runs[i].done;
+    }
+
+    stop_load (load_pids);
+
+    /* the frames on hold are not paced */
+    cpu = cpu_ns () - cpu - held_cpu;
+    total -= held_frames;
+    alloc_count = g_atomic_int_get (&allocs) - alloc_count;
+
+    printf ("cpu:        %" G_GINT64_FORMAT " ns/frame\n",
+            total ? cpu / total : 0);
+#ifdef HAVE_ALLOC_COUNT
+    printf ("allocs:     %.2f/frame\n",
+            total ? (gdouble) alloc_count / total : 0.0);
+#endif
+
+    for (i = 0; i < 2; i++) {
+        if (!enabled[i])
+            continue;
+
+        report_direction (&runs[i]);
+
+        mm_backend_audio_close (backends[i]);
+        g_object_unref (backends[i]);
+        g_free (runs[i].times);
+    }
+
+    if (idle > 0)
+        measure_idle ();
+
+    return 0;
+}
+
+/* keeps the compiler from dropping the kernels */
+static volatile guint64 sink;
+
+#define MICRO_FRAMES 160
+#define MICRO_ROUNDS 20000
+
+static void
+report_micro (const gchar *name, gboolean simd, gint64 elapsed)
+{
+    printf ("  %-24s %-6s %6.2f ns/frame\n", name, simd ? "simd" : "scalar",
+            (gdouble) elapsed / ((gdouble) MICRO_ROUNDS * MICRO_FRAMES));
+}
+
+static void
+micro_convert (const gchar *name, MmAudioFormat format, guint src_channels,
+               guint dest_channels, gboolean simd)
+{
+    guint8 *src = g_malloc0 (MICRO_FRAMES * 2 * 4);
+    gint16 *dest = g_new0 (gint16, MICRO_FRAMES * 2);
+    gint64 start;
+    guint i;
+
+    for (i = 0; i < MICRO_FRAMES * 2 * 4; i++)
+        src[i] = g_random_int ();
+    if (format == MM_AUDIO_FORMAT_F32) {
+        for (i = 0; i < MICRO_FRAMES * 2; i++)
+            ((gfloat *) src)[i] = g_random_double_range (-1.0, 1.0);
+    }
+
+    start = now_ns ();
+    for (i = 0; i < MICRO_ROUNDS; i++) {
+        mm_audio_convert (dest, dest_channels, src, format, src_channels,
+                          MICRO_FRAMES);
+        sink += dest[i % MICRO_FRAMES];
+    }
+    report_micro (name, simd, now_ns () - start);
+
+    g_free (src);
+    g_free (dest);
+}
+
+static void
+micro_kernels (gboolean simd)
+{
+    gint16 samples[MICRO_FRAMES];
+    gint64 start;
+    guint i, crossings;
+
+    mm_audio_set_simd (simd);
+
+    micro_convert ("convert s16 stereo/mono", MM_AUDIO_FORMAT_S16, 2, 1, simd);
+    micro_convert ("convert s16 mono/stereo", MM_AUDIO_FORMAT_S16, 1, 2, simd);
+    micro_convert ("convert s24 mono", MM_AUDIO_FORMAT_S24, 1, 1, simd);
+    micro_convert ("convert s32 mono", MM_AUDIO_FORMAT_S32, 1, 1, simd);
+    micro_convert ("convert f32 mono", MM_AUDIO_FORMAT_F32, 1, 1, simd);
+
+    for (i = 0; i < MICRO_FRAMES; i++)
+        samples[i] = g_random_int ();
+
+    start = now_ns ();
+    for (i = 0; i < MICRO_ROUNDS; i++) {
+        mm_audio_apply_gain (samples, MICRO_FRAMES, MM_AUDIO_GAIN_UNITY + 1);
+        sink += samples[i % MICRO_FRAMES];
+    }
+    report_micro ("gain", simd, now_ns () - start);
+
+    start = now_ns ();
+    for (i = 0; i < MICRO_ROUNDS; i++)
+        sink += mm_audio_energy (samples, MICRO_FRAMES, &crossings) + crossings;
+    report_micro ("energy", simd, now_ns () - start);
+
+    mm_audio_set_simd (TRUE);
+}
+
+/* a block of the conference: every leg summed, then the mix-minus of
+ * each leg and the mix for the speakers */
+static void
+micro_mixer (guint legs, gboolean simd)
+{
+    gint16 *blocks = g_new (gint16, legs * MICRO_FRAMES);
+    gint16 out[MICRO_FRAMES];
+    gint32 mix[MICRO_FRAMES];
+    gchar name[32];
+    gint64 start;
+    guint i, j;
+
+    for (i = 0; i < legs * MICRO_FRAMES; i++)
+        blocks[i] = g_random_int ();
+
+    mm_audio_set_simd (simd);
+
+    start = now_ns ();
+    for (i = 0; i < MICRO_ROUNDS; i++) {
+        memset (mix, 0, sizeof (mix));
+        for (j = 0; j < legs; j++)
+            mm_audio_accumulate (mix, blocks + j * MICRO_FRAMES, MICRO_FRAMES);
+        for (j = 0; j < legs; j++) {
+            mm_audio_mix_minus (out, mix, blocks + j * MICRO_FRAMES, MICRO_FRAMES);
+            sink += out[i % MICRO_FRAMES];
+        }
+        mm_audio_mix_minus (out, mix, NULL, MICRO_FRAMES);
+        sink += out[i % MICRO_FRAMES];
+    }
+
+    g_snprintf (name, sizeof (name), "mixer, %u legs", legs);
+    report_micro (name, simd, now_ns () - start);
+
+    mm_audio_set_simd (TRUE);
+    g_free (blocks);
+}
+
+/* a frame through the ring, against the adapter it replaced, with
+ * the buffer the streaming thread would have allocated */
+static void
+micro_queues (void)
+{
+    const gsize len = MICRO_FRAMES * 2;
+    guint8 *frame = g_malloc0 (len), *out = g_malloc0 (len);
+    MmRing *ring = mm_ring_new (len * 4);
+    GstAdapter *adapter;
+    gint64 start;
+    guint i;
+
+    start = now_ns ();
+    for (i = 0; i < MICRO_ROUNDS; i++) {
+        mm_ring_write (ring, frame, len);
+        sink += mm_ring_read (ring, out, len);
+    }
+    printf ("  %-24s %-6s %6.2f ns/frame\n", "ring", "",
+            (gdouble) (now_ns () - start) / ((gdouble) MICRO_ROUNDS * MICRO_FRAMES));
+
+    gst_init (NULL, NULL);
+    adapter = gst_adapter_new ();
+
+    start = now_ns ();
+    for (i = 0; i < MICRO_ROUNDS; i++) {
+        GstBuffer *buffer = gst_buffer_new_allocate (NULL, len, NULL);
+
+        gst_buffer_fill (buffer, 0, frame, len);
+        gst_adapter_push (adapter, buffer);
+        gst_adapter_copy (adapter, out, 0, len);
+        gst_adapter_flush (adapter, len);
+        sink += out[0];
+    }
+    printf ("  %-24s %-6s %6.2f ns/frame\n", "adapter", "",
+            (gdouble) (now_ns () - start) / ((gdouble) MICRO_ROUNDS * MICRO_FRAMES));
+
+    g_object_unref (adapter);
+    mm_ring_free (ring);
+    g_free (frame);
+    g_free (out);
+}
+
+static int
+run_micro (void)
+{
+    guint legs;
+
+    printf ("%d frames, %d rounds\n", MICRO_FRAMES, MICRO_ROUNDS);
+
+#ifdef __SSE2__
+    micro_kernels (TRUE);
+#endif
+    micro_kernels (FALSE);
+
+    for (legs = 2; legs <= 32; legs *= 2) {
+#ifdef __SSE2__
+        micro_mixer (legs, TRUE);
+#endif
+        micro_mixer (legs, FALSE);
+    }
+
+    micro_queues ();
+
+    return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+
+    context = g_option_context_new ("- benchmark the media path");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        g_printerr ("%s\n", error->message);
+        return 1;
+    }
+    g_option_context_free (context);
+
+    if (micro)
+        return run_micro ();
+
+    if (!device)
+        device = g_strdup ("Gst:test");
+
+    if (rate <= 0 || channels < 1 || channels > 2 || frame_ms <= 0 ||
+        seconds <= 0 || buffers < 0 || (player_only && recorder_only)) {
+        g_printerr ("invalid options\n");
+        return 1;
+    }
+
+    /* the synthetic devices are never kept between calls: the Gst
+     * device on test elements is, as the sound hardware would be */
+    if ((source_element &&
+         !mm_backend_set_audio_element (MM_BACKEND_DIRECTION_RECORDER,
+                                        source_element)) ||
+        (sink_element &&
+         !mm_backend_set_audio_element (MM_BACKEND_DIRECTION_PLAYER,
+                                        sink_element))) {
+        g_printerr ("invalid elements\n");
+        return 1;
+    }
+
+    if (idle_policy) {
+        if (g_str_equal (idle_policy, "teardown")) {
+            mm_backend_set_idle_policy (MM_BACKEND_IDLE_TEARDOWN);
+        } else if (g_str_equal (idle_policy, "ready")) {
+            mm_backend_set_idle_policy (MM_BACKEND_IDLE_READY);
+        } else if (g_str_equal (idle_policy, "warm")) {
+            mm_backend_set_idle_policy (MM_BACKEND_IDLE_WARM);
+        } else {
+            g_printerr ("unknown idle policy %s\n", idle_policy);
+            return 1;
+        }
+    }
+
+    if (realtime) {
+        MmBackendRealtime policy;
+
+        if (g_str_equal (realtime, "none")) {
+            policy = MM_BACKEND_REALTIME_NONE;
+        } else if (g_str_equal (realtime, "nice")) {
+            policy = MM_BACKEND_REALTIME_NICE;
+        } else if (g_str_equal (realtime, "rr")) {
+            policy = MM_BACKEND_REALTIME_RR;
+        } else if (g_str_equal (realtime, "fifo")) {
+            policy = MM_BACKEND_REALTIME_FIFO;
+        } else {
+            g_printerr ("unknown scheduling %s\n", realtime);
+            return 1;
+        }
+
+        if (!priority)
+            priority = policy == MM_BACKEND_REALTIME_NICE ? -15 : 10;
+        mm_backend_set_realtime (policy, priority);
+    }
+
+    if (cpus && !mm_backend_set_cpu_affinity (cpus)) {
+        g_printerr ("invalid CPUs %s\n", cpus);
+        return 1;
+    }
+
+    return run_backend ();
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2026 Igalia S.L.
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#include "mmring.h"
+
+#include <string.h>
+
+#define CACHE_LINE 64
+
+/*
+ * A single producer, single consumer, ring of bytes. The producer
+ * only moves the head, the consumer only the tail, so neither takes a
+ * lock. Both are free running counters, wrapping at 2^32, and each
+ * sits in its own cache line so the two threads do not bounce it.
+ */
+struct _MmRing {
+    volatile gint head;   /* bytes ever written */
+    gchar pad0[CACHE_LINE - sizeof (gint)];
+    volatile gint tail;   /* bytes ever read */
+    gchar pad1[CACHE_LINE - sizeof (gint)];
+
+    guint8 *data;
+    gsize size;           /* a power of two */
+};
+
+/**
+ * mm_ring_new:
+ * @size: the minimum capacity, in bytes
+ *
+ * Returns: a new ring, holding @size bytes rounded up to a power of two
+ */
+MmRing *
+mm_ring_new (gsize size)
+{
+    MmRing *ring;
+    gsize capacity = 1;
+
+    g_return_val_if_fail (size > 0 && size <= G_MAXINT / 2 + 1, NULL);
+
+    while (capacity < size)
+        capacity <<= 1;
+
+    ring = g_malloc0 (sizeof (MmRing));
+    ring->data = g_malloc (capacity);
+    ring->size = capacity;
+
+    return ring;
+}
+
+void
+mm_ring_free (MmRing *ring)
+{
+    if (!ring)
+        return;
+
+    g_free (ring->data);
+    g_free (ring);
+}
+
+gsize
+mm_ring_get_size (MmRing *ring)
+{
+    return ring->size;
+}
+
+/* only while neither side uses the ring */
+void
+mm_ring_reset (MmRing *ring)
+{
+    g_atomic_int_set (&ring->head, 0);
+    g_atomic_int_set (&ring->tail, 0);
+}
+
+/* the producer and the consumer may call this */
+gsize
+mm_ring_available (MmRing *ring)
+{
+    guint head = g_atomic_int_get (&ring->head);
+    guint tail = g_atomic_int_get (&ring->tail);
+
+    return head - tail;
+}
+
+/* the producer and the consumer may call this */
+gsize
+mm_ring_space (MmRing *ring)
+{
+    return ring->size - mm_ring_available (ring);
+}
+
+/**
+ * mm_ring_write:
+ * @ring: a #MmRing
+ * @data: the bytes to write
+ * @len: their count
+ *
+ * Copies @data in, if it fits whole. Only the producer may call it.
+ *
+ * Returns: @len, or 0 if there is not room for it
+ */
+gsize
+mm_ring_write (MmRing *ring, const guint8 *data, gsize len)
+{
+    guint head = g_atomic_int_get (&ring->head);
+    gsize offset, first;
+
+    if (len > mm_ring_space (ring))
+        return 0;
+
+    offset = head & (ring->size - 1);
+    first = MIN (len, ring->size - offset);
+
+    memcpy (ring->data + offset, data, first);
+    memcpy (ring->data, data + first, len - first);
+
+    /* publishes the bytes only once copied */
+    g_atomic_int_set (&ring->head, head + len);
+
+    return len;
+}
+
+/**
+ * mm_ring_read:
+ * @ring: a #MmRing
+ * @dest: where to copy the bytes
+ * @len: the maximum count
+ *
+ * Copies out up to @len bytes. Only the consumer may call it.
+ *
+ * Returns: the bytes copied
+ */
+gsize
+mm_ring_read (MmRing *ring, guint8 *dest, gsize len)
+{
+    guint tail = g_atomic_int_get (&ring->tail);
+    gsize available = mm_ring_available (ring);
+    gsize offset, first;
+
+    len = MIN (len, available);
+
+    offset = tail & (ring->size - 1);
+    first = MIN (len, ring->size - offset);
+
+    memcpy (dest, ring->data + offset, first);
+    memcpy (dest + first, ring->data, len - first);
+
+    /* hands the room back only once copied */
+    g_atomic_int_set (&ring->tail, tail + len);
+
+    return len;
+}
+
+/**
+ * mm_ring_skip:
+ * @ring: a #MmRing
+ * @len: the maximum count
+ *
+ * Discards up to @len of the oldest bytes. Only the consumer may call
+ * it.
+ *
+ * Returns: the bytes discarded
+ */
+gsize
+mm_ring_skip (MmRing *ring, gsize len)
+{
+    gsize available = mm_ring_available (ring);
+
+    len = MIN (len, available);
+    g_atomic_int_add (&ring->tail, len);
+
+    return len;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2026 Igalia S.L.
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#ifndef MM_RING_H
+#define MM_RING_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MmRing MmRing;
+
+MmRing *
+mm_ring_new                                     (gsize size);
+
+void
+mm_ring_free                                    (MmRing *ring);
+
+gsize
+mm_ring_get_size                                (MmRing *ring);
+
+void
+mm_ring_reset                                   (MmRing *ring);
+
+gsize
+mm_ring_write                                   (MmRing *ring,
+                                                 const guint8 *data,
+                                                 gsize len);
+
+gsize
+mm_ring_read                                    (MmRing *ring,
+                                                 guint8 *dest,
+                                                 gsize len);
+
+gsize
+mm_ring_skip                                    (MmRing *ring,
+                                                 gsize len);
+
+gsize
+mm_ring_available                               (MmRing *ring);
+
+gsize
+mm_ring_space                                   (MmRing *ring);
+
+G_END_DECLS
+
+#endif /* MM_RING_H */
@@ -21,6 +21,14 @@ public class Model : Object {
 	public Registrars registrars { construct; private get; }
 	public string call_token { get; private set; default = null; }
 
+	// the calls added to the current one, in conference mode
+	private GenericArray<string> conference_tokens = new GenericArray<string> ();
+
+	public bool conference {
+		get { return pcssep.get_conference_audio (); }
+		set { pcssep.set_conference_audio (value); }
+	}
+
 	public Model (Config config, Registrars registrars) {
 		Object (config: config, registrars: registrars);
 
@@ -152,7 +160,34 @@ public class Model : Object {
 		return false;
 	}
 
+	private int find_conference_call (string? token) {
+		for (int i = 0; i < conference_tokens.length; i++) {
+			if (conference_tokens[i] == token)
+				return i;
+		}
+
+		return -1;
+	}
+
+	// calls another party into the current call, which has to be in
+	// conference mode
+	public bool add_call (string remote_party) {
+		string token;
+
+		if (call_token == null || !conference)
+			return false;
+
+		if (!manager.setup_call (null, remote_party, out token, 0, null))
+			return false;
+
+		conference_tokens.add (token);
+		return true;
+	}
+
 	private void on_call_established (string? token) {
+		if (find_conference_call (token) >= 0)
+			return;
+
 		assert (call_token == token);
 		call_established ();
 	}
@@ -160,6 +195,12 @@ public class Model : Object {
 	private void on_call_cleared (string? token,
 								  string? party,
 								  CallEndReason reason) {
+		int i = find_conference_call (token);
+		if (i >= 0) {
+			conference_tokens.remove_index (i);
+			return;
+		}
+
 		if (call_token == null)
 			return; // ignore this: perhaps the call setup failed
 
@@ -179,6 +220,9 @@ public class Model : Object {
 	}
 
 	public bool hangup_call () {
+		for (int i = 0; i < conference_tokens.length; i++)
+			manager.clear_call (conference_tokens[i], CallEndReason.LOCALUSER);
+
 		return manager.clear_call (call_token, CallEndReason.LOCALUSER);
 	}
 
@@ -10,18 +10,16 @@
 
 #include <ptlib.h>
 #include <ptlib/sound.h>
-#include <ptclib/delaychan.h>
 
-#include "mmbackend.h"
+#include "soundgst.h"
 
 class PSoundChannelGst : public PSoundChannel
 {
     PCLASSINFO(PSoundChannelGst, PSoundChannel);
 
 public:
-    PSoundChannelGst(MmBackend *backend) : m_backend(backend) {
-        g_object_ref(m_backend);
-    };
+    // takes the ownership of the backend reference
+    PSoundChannelGst(MmBackend *backend, const char *token = NULL);
     ~PSoundChannelGst();
     PBoolean Open(const PString &device,
                   Directions dir,
@@ -32,46 +30,193 @@ public:
     PBoolean Write(const void * buf, PINDEX len);
     PBoolean Read(void * buf, PINDEX len);
     PBoolean IsOpen() const;
-    PBoolean SetBuffers(PINDEX size, PINDEX count) { return PTrue; }
+    PBoolean SetBuffers(PINDEX size, PINDEX count);
+    PBoolean GetBuffers(PINDEX & size, PINDEX & count);
 
     static PStringArray GetDeviceNames(PSoundChannel::Directions);
 
+    static void SetHold(const char *token, gboolean hold);
+    static gboolean SwitchDevice(const char *token,
+                                 Directions dir,
+                                 const char *device);
+    static guint64 GetDeadlineMisses(const char *token);
+
 private:
     MmBackend *m_backend;
-    PAdaptiveDelay m_pacing;
+    gchar *m_token;         // the call, NULL if unknown
+    Directions m_direction;
+    bool m_opened;
     unsigned m_sampleRate;
     unsigned m_sampleSize;
+    PINDEX m_bufferSize;
+    PINDEX m_bufferCount;
 };
 
+// the channels of the calls, and the calls on hold
+static GMutex channels_lock;
+static GList *channels = NULL;
+static GHashTable *held_calls = NULL;
+
+PSoundChannelGst::PSoundChannelGst(MmBackend *backend, const char *token)
+    : m_backend(backend), m_token(g_strdup(token)), m_direction(Player),
+      m_opened(false), m_bufferSize(0), m_bufferCount(0)
+{
+    if (!m_token)
+        return;
+
+    g_mutex_lock(&channels_lock);
+    channels = g_list_prepend(channels, this);
+    g_mutex_unlock(&channels_lock);
+}
+
 PSoundChannelGst::~PSoundChannelGst()
 {
+    Close();
+
+    if (m_token) {
+        g_mutex_lock(&channels_lock);
+        channels = g_list_remove(channels, this);
+        g_mutex_unlock(&channels_lock);
+        g_free(m_token);
+    }
+
     g_object_unref(m_backend);
 }
 
+void PSoundChannelGst::SetHold(const char *token, gboolean hold)
+{
+    GList *l;
+
+    g_mutex_lock(&channels_lock);
+
+    if (!held_calls)
+        held_calls = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                           g_free, NULL);
+
+    if (hold)
+        g_hash_table_add(held_calls, g_strdup(token));
+    else
+        g_hash_table_remove(held_calls, token);
+
+    // a backend shared by both channels takes it twice, harmlessly
+    for (l = channels; l; l = l->next) {
+        PSoundChannelGst *channel = (PSoundChannelGst *) l->data;
+
+        if (g_str_equal(channel->m_token, token))
+            mm_backend_set_hold(channel->m_backend, hold);
+    }
+
+    g_mutex_unlock(&channels_lock);
+}
+
+gboolean PSoundChannelGst::SwitchDevice(const char *token,
+                                        Directions dir,
+                                        const char *device)
+{
+    gboolean ret = TRUE;
+    GList *l, *backends = NULL;
+
+    g_mutex_lock(&channels_lock);
+
+    for (l = channels; l; l = l->next) {
+        PSoundChannelGst *channel = (PSoundChannelGst *) l->data;
+
+        if (!g_str_equal(channel->m_token, token) ||
+            channel->m_direction != dir || !channel->m_opened)
+            continue;
+
+        backends = g_list_prepend(backends, g_object_ref(channel->m_backend));
+    }
+
+    g_mutex_unlock(&channels_lock);
+
+    // bringing the new device up takes a while: the other calls do
+    // not wait for it
+    for (l = backends; l; l = l->next) {
+        ret = mm_backend_switch_device((MmBackend *) l->data,
+                                       (MmBackendDirection) dir,
+                                       device) && ret;
+    }
+
+    ret = backends && ret;
+    g_list_free_full(backends, g_object_unref);
+
+    return ret;
+}
+
+guint64 PSoundChannelGst::GetDeadlineMisses(const char *token)
+{
+    MmBackendStats stats;
+    GList *l, *seen = NULL;
+    guint64 misses = 0;
+
+    g_mutex_lock(&channels_lock);
+
+    // the channels of a duplex call share their backend
+    for (l = channels; l; l = l->next) {
+        PSoundChannelGst *channel = (PSoundChannelGst *) l->data;
+
+        if (!g_str_equal(channel->m_token, token) ||
+            g_list_find(seen, channel->m_backend))
+            continue;
+
+        seen = g_list_prepend(seen, channel->m_backend);
+        mm_backend_get_stats(channel->m_backend, &stats);
+        misses += stats.deadline_misses;
+    }
+
+    g_mutex_unlock(&channels_lock);
+    g_list_free(seen);
+
+    return misses;
+}
+
 PBoolean PSoundChannelGst::Open(const PString & device,
                                 Directions dir,
                                 unsigned numChannels,
                                 unsigned sampleRate,
                                 unsigned bitsPerSample)
 {
+    m_direction = dir;
     m_sampleRate = sampleRate;
     m_sampleSize = bitsPerSample;
 
-    return mm_backend_audio_open(m_backend,
-                                 (const char *) device,
-                                 (MmBackendDirection) dir,
-                                 numChannels,
-                                 sampleRate);
+    if (!mm_backend_audio_open(m_backend,
+                               (const char *) device,
+                               (MmBackendDirection) dir,
+                               numChannels,
+                               sampleRate,
+                               bitsPerSample))
+        return PFalse;
+
+    m_opened = true;
+
+    // Opal may open the media again while the call is on hold
+    g_mutex_lock(&channels_lock);
+    if (m_token && held_calls && g_hash_table_contains(held_calls, m_token))
+        mm_backend_set_hold(m_backend, TRUE);
+    g_mutex_unlock(&channels_lock);
+
+    return PTrue;
 }
 
 PBoolean PSoundChannelGst::Close()
 {
-    return PTrue;
+    if (!m_opened)
+        return PTrue;
+
+    // wakes up a thread blocked in Read or Write, as Opal expects; in
+    // duplex mode the other direction goes on
+    m_opened = false;
+    return mm_backend_audio_close_direction(m_backend,
+                                            (MmBackendDirection) m_direction);
 }
 
 PBoolean PSoundChannelGst::IsOpen() const
 {
-    return mm_backend_audio_is_open(m_backend);
+    return m_opened &&
+        mm_backend_audio_is_direction_open(m_backend,
+                                           (MmBackendDirection) m_direction);
 }
 
 PBoolean PSoundChannelGst::Write(const void * buf, PINDEX len)
@@ -79,15 +224,12 @@ PBoolean PSoundChannelGst::Write(const void * buf, PINDEX len)
     size_t written;
     PBoolean ret;
 
+    // As GStreamer is highly asynchronic and Opal expects
+    // synchronicity, the backend blocks the write until the
+    // pipeline has consumed enough of the queued audio.
     ret = mm_backend_audio_write(m_backend, buf, len, &written);
     lastWriteCount = ret ? written : 0;
 
-    // As GStreamer is highly asynchronic and Opal expects
-    // synchronicity, we should simulate the delay at writing.
-    // The value of the delay is the same as the call
-    // PCSSEP.SetSoundChannelBufferTime(depth)
-    m_pacing.Delay(20);
-
     return ret;
 }
 
@@ -102,21 +244,71 @@ PBoolean PSoundChannelGst::Read(void * buf, PINDEX len)
     return ret;
 }
 
+PBoolean PSoundChannelGst::SetBuffers(PINDEX size, PINDEX count)
+{
+    m_bufferSize = size;
+    m_bufferCount = count;
+
+    mm_backend_set_buffers(m_backend,
+                           (MmBackendDirection) m_direction,
+                           size,
+                           count);
+    return PTrue;
+}
+
+PBoolean PSoundChannelGst::GetBuffers(PINDEX & size, PINDEX & count)
+{
+    size = m_bufferSize;
+    count = m_bufferCount;
+    return PTrue;
+}
+
 PStringArray PSoundChannelGst::GetDeviceNames(Directions dir)
 {
     PStringArray devices;
+    GPtrArray *names;
+    guint i;
+
     devices.AppendString("Gst");
+    // tone generator and fake sink, for testing without sound hardware;
+    // "Gst:wav=<file>" is accepted too, but cannot be listed
+    devices.AppendString("Gst:test");
+
+    // as last seen by the device monitor, without probing them
+    names = mm_backend_get_devices((MmBackendDirection) dir);
+    for (i = 0; i < names->len; i++)
+        devices.AppendString(PString("Gst:dev=") +
+                             (const char *) g_ptr_array_index(names, i));
+    g_ptr_array_unref(names);
+
     return devices;
 }
 
+static bool
+has_device_prefix(const PString & name, const char *prefix)
+{
+    PINDEX len = strlen(prefix);
+
+    return name.NumCompare(prefix, len) == PObject::EqualTo &&
+        name.GetLength() > len;
+}
+
+// a "Gst:dev=" device that was unplugged opens the default one
+static bool
+is_device_name(const PString & name)
+{
+    return name == "Gst" || name == "Gst:test" ||
+        has_device_prefix(name, "Gst:wav=") ||
+        has_device_prefix(name, "Gst:dev=");
+}
+
 class PSoundChannelPluginServiceDescriptorGst : public PDevicePluginServiceDescriptor
 {
 public:
-    PSoundChannelPluginServiceDescriptorGst(MmBackend *backend)
-        : m_backend (backend) { }
-
+    // every channel gets its own backend, hence its own pipeline and
+    // streaming thread
     virtual PObject *CreateInstance(int userData) const
-        { return new PSoundChannelGst(m_backend); }
+        { return new PSoundChannelGst(mm_backend_new()); }
 
     virtual PStringArray GetDeviceNames(int userData) const
         {
@@ -125,25 +317,246 @@ public:
                 );
         }
 
-private:
-    MmBackend *m_backend;
+    virtual bool ValidateDeviceName(const PString & deviceName,
+                                    int userData) const
+        { return is_device_name(deviceName); }
 };
 
+static gboolean duplex_mode = FALSE;
+static gboolean conference_mode = FALSE;
+
+// duplex or conference backends, shared by the player and the
+// recorder of a call
+static GMutex call_backends_lock;
+static GHashTable *call_backends = NULL;
+
+static void
+call_backend_finalized(gpointer token, GObject *backend)
+{
+    g_mutex_lock(&call_backends_lock);
+    if (g_hash_table_lookup(call_backends, token) == backend)
+        g_hash_table_remove(call_backends, token);
+    g_mutex_unlock(&call_backends_lock);
+}
+
+static MmBackend *
+get_call_backend(const char *token)
+{
+    MmBackend *backend;
+    gchar *key;
+
+    g_mutex_lock(&call_backends_lock);
+
+    if (!call_backends)
+        call_backends = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                              g_free, NULL);
+
+    backend = (MmBackend *) g_hash_table_lookup(call_backends, token);
+    if (backend) {
+        g_object_ref(backend);
+    } else {
+        backend = mm_backend_new();
+        mm_backend_set_duplex(backend, TRUE);
+        mm_backend_set_conference(backend, conference_mode);
+
+        key = g_strdup(token);
+        g_hash_table_insert(call_backends, key, backend);
+        g_object_weak_ref(G_OBJECT(backend), call_backend_finalized, key);
+    }
+
+    g_mutex_unlock(&call_backends_lock);
+
+    return backend;
+}
+
+PSoundChannel *
+sound_channel_new_for_call(const char *token)
+{
+    if (!token)
+        return new PSoundChannelGst(mm_backend_new());
+
+    if (!duplex_mode && !conference_mode)
+        return new PSoundChannelGst(mm_backend_new(), token);
+
+    return new PSoundChannelGst(get_call_backend(token), token);
+}
+
 G_BEGIN_DECLS
 
 /**
  * load_sound_channel: (skip)
- * @backend: a #MmBackend instance
  *
  * Loads the Gstreamer-based sound channel
  */
 gboolean
-load_sound_channel(MmBackend *backend)
+load_sound_channel(void)
 {
-    static PSoundChannelPluginServiceDescriptorGst GstSCDesc(backend);
+    static PSoundChannelPluginServiceDescriptorGst GstSCDesc;
+
+    // the devices are listed from then on without stalling a call
+    mm_backend_monitor_devices();
+
     return PPluginManager::GetPluginManager().RegisterService("Gst",
                                                               "PSoundChannel",
                                                               &GstSCDesc);
 }
 
+/**
+ * sound_channel_set_duplex: (skip)
+ * @duplex: whether a call runs its player and recorder in one pipeline
+ *
+ * Applies to the sound channels created afterwards through
+ * sound_channel_new_for_call().
+ */
+void
+sound_channel_set_duplex(gboolean duplex)
+{
+    duplex_mode = duplex;
+}
+
+/**
+ * sound_channel_get_duplex: (skip)
+ *
+ * Returns: %TRUE if the calls use a duplex pipeline
+ */
+gboolean
+sound_channel_get_duplex(void)
+{
+    return duplex_mode;
+}
+
+/**
+ * sound_channel_set_conference: (skip)
+ * @conference: whether the calls are legs of one conference
+ *
+ * Applies to the sound channels created afterwards through
+ * sound_channel_new_for_call().
+ */
+void
+sound_channel_set_conference(gboolean conference)
+{
+    conference_mode = conference;
+}
+
+/**
+ * sound_channel_get_conference: (skip)
+ *
+ * Returns: %TRUE if the calls are mixed into a conference
+ */
+gboolean
+sound_channel_get_conference(void)
+{
+    return conference_mode;
+}
+
+/**
+ * sound_channel_set_hold: (skip)
+ * @token: the token of the call
+ * @hold: whether the call is on hold
+ *
+ * Parks, or resumes, the media of the sound channels of the call
+ * created through sound_channel_new_for_call(), including the ones
+ * opened while it stays on hold.
+ */
+void
+sound_channel_set_hold(const char *token, gboolean hold)
+{
+    g_return_if_fail(token != NULL);
+
+    PSoundChannelGst::SetHold(token, hold);
+}
+
+/**
+ * sound_channel_get_hold: (skip)
+ * @token: the token of the call
+ *
+ * Returns: %TRUE if the media of the call is on hold
+ */
+gboolean
+sound_channel_get_hold(const char *token)
+{
+    gboolean held;
+
+    g_return_val_if_fail(token != NULL, FALSE);
+
+    g_mutex_lock(&channels_lock);
+    held = held_calls && g_hash_table_contains(held_calls, token);
+    g_mutex_unlock(&channels_lock);
+
+    return held;
+}
+
+/**
+ * sound_channel_switch_device: (skip)
+ * @token: the token of the call
+ * @dir: the direction to move
+ * @device: the name of the device, as sound_channel_list_devices()
+ * gives it
+ *
+ * Moves the open sound channel of the call in @dir to @device, without
+ * stopping its media.
+ *
+ * Returns: %TRUE if the channel now runs on @device
+ */
+gboolean
+sound_channel_switch_device(const char *token,
+                            MmBackendDirection dir,
+                            const char *device)
+{
+    g_return_val_if_fail(token != NULL, FALSE);
+
+    return PSoundChannelGst::SwitchDevice(token,
+                                          (PSoundChannel::Directions) dir,
+                                          device);
+}
+
+/**
+ * sound_channel_get_deadline_misses: (skip)
+ * @token: the token of the call
+ *
+ * Returns: the buffers the streaming threads of the sound channels of
+ * the call handed over late, as counted in deadline_misses
+ */
+guint64
+sound_channel_get_deadline_misses(const char *token)
+{
+    g_return_val_if_fail(token != NULL, 0);
+
+    return PSoundChannelGst::GetDeadlineMisses(token);
+}
+
+/**
+ * sound_channel_list_devices: (skip)
+ * @dir: the direction of the devices
+ *
+ * Returns: the names of the devices of the GStreamer sound channel,
+ * as Opal opens them; free with g_strfreev()
+ */
+gchar **
+sound_channel_list_devices(MmBackendDirection dir)
+{
+    PStringArray devices =
+        PSoundChannelGst::GetDeviceNames((PSoundChannel::Directions) dir);
+    gchar **names = g_new0(gchar *, devices.GetSize() + 1);
+    PINDEX i;
+
+    for (i = 0; i < devices.GetSize(); i++)
+        names[i] = g_strdup(devices[i]);
+
+    return names;
+}
+
+/**
+ * sound_channel_prewarm: (skip)
+ *
+ * Prepares in the background the pipelines of the next call, so its
+ * audio starts as soon as it is answered.
+ */
+void
+sound_channel_prewarm(void)
+{
+    // the conference runs in a duplex pipeline
+    mm_backend_prewarm(duplex_mode || conference_mode);
+}
+
 G_END_DECLS
@@ -16,8 +16,48 @@
 G_BEGIN_DECLS
 
 gboolean
-load_sound_channel                              (MmBackend *backend);
+load_sound_channel                              (void);
+
+void
+sound_channel_set_duplex                        (gboolean duplex);
+
+gboolean
+sound_channel_get_duplex                        (void);
+
+void
+sound_channel_set_conference                    (gboolean conference);
+
+gboolean
+sound_channel_get_conference                    (void);
+
+void
+sound_channel_set_hold                          (const char *token,
+                                                 gboolean hold);
+
+gboolean
+sound_channel_get_hold                          (const char *token);
+
+gboolean
+sound_channel_switch_device                     (const char *token,
+                                                 MmBackendDirection dir,
+                                                 const char *device);
+
+guint64
+sound_channel_get_deadline_misses               (const char *token);
+
+gchar **
+sound_channel_list_devices                      (MmBackendDirection dir);
+
+void
+sound_channel_prewarm                           (void);
 
 G_END_DECLS
 
+#ifdef __cplusplus
+class PSoundChannel;
+
+PSoundChannel *
+sound_channel_new_for_call                      (const char *token);
+#endif
+
 #endif /* SOUND_GST_H */